@@ -0,0 +1,918 @@
+// CMSC 341 - Spring 2024 - Project 4
+// Performance benchmarks for VacDB, run as: Benchmark [mode]
+// modes: readers, migration, filter, checkpoint, counters, pages, adaptive, rebuild, tiers, aggregates, export, combining, replication, chains
+#include "vacdb.h"
+#include "perfcounters.h"
+#include "combiner.h"
+#include "replication.h"
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+unsigned int hashCode(const string str);
+
+// generates count distinct patients with 10-letter names
+vector<Patient> makePatients(int count, int seed) {
+    mt19937 generator(seed);
+    uniform_int_distribution<> letter('a', 'z');
+    uniform_int_distribution<> serial(MINID, MAXID);
+    vector<Patient> patients;
+    patients.reserve(count);
+    for (int i = 0; i < count; i++) {
+        string name(10, ' ');
+        for (char &c: name) {
+            c = char(letter(generator));
+        }
+        patients.push_back(Patient(name, serial(generator), true));
+    }
+    return patients;
+}
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// value below which the given fraction of the samples lie
+double percentile(vector<double> samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t rank = min(samples.size() - 1, size_t(fraction * samples.size()));
+    nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+// lookups per second with numReaders threads calling getPatient() while one writer keeps inserting
+// and removing patients, either lock-free or with every call under a reader-writer lock
+double readerThroughput(int numReaders, bool lockFree, double seconds) {
+    const int numResident = 10000;
+    const int numChurn = 10000;
+    vector<Patient> resident = makePatients(numResident, 1);
+    vector<Patient> churn = makePatients(numChurn, 2);
+
+    VacDB vacdb(MINPRIME, hashCode, DOUBLEHASH);
+    for (Patient &patient: resident) {
+        vacdb.insert(patient);
+    }
+    if (lockFree) {
+        vacdb.enableConcurrentReaders();
+    }
+
+    shared_mutex lock;
+    atomic<bool> stop(false);
+    atomic<long> lookups(0);
+
+    //the writer cycles through the churn set so that tables are rehashed and patients retired all the time
+    thread writer([&]() {
+        for (int i = 0; !stop.load(memory_order_relaxed); i = (i + 1) % numChurn) {
+            if (lockFree) {
+                vacdb.insert(churn[i]);
+                vacdb.remove(churn[(i + numChurn / 2) % numChurn]);
+            } else {
+                unique_lock<shared_mutex> guard(lock);
+                vacdb.insert(churn[i]);
+                vacdb.remove(churn[(i + numChurn / 2) % numChurn]);
+            }
+        }
+    });
+
+    vector<thread> readers;
+    for (int r = 0; r < numReaders; r++) {
+        readers.emplace_back([&, r]() {
+            long count = 0;
+            for (int i = r; !stop.load(memory_order_relaxed); i = (i + 7) % numResident, count++) {
+                if (lockFree) {
+                    vacdb.getPatient(resident[i].getKey(), resident[i].getSerial());
+                } else {
+                    shared_lock<shared_mutex> guard(lock);
+                    vacdb.getPatient(resident[i].getKey(), resident[i].getSerial());
+                }
+            }
+            lookups += count;
+        });
+    }
+
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    writer.join();
+    for (thread &reader: readers) {
+        reader.join();
+    }
+    return lookups / seconds;
+}
+
+void benchReaderScaling() {
+    int maxThreads = max(1, int(thread::hardware_concurrency()));
+    cout << "Reader scaling (one writer, lookups per second)" << endl;
+    cout << setw(8) << "readers" << setw(16) << "lock-free" << setw(16) << "rwlock" << endl;
+    //1, 2, 4, ... readers, always ending with all hardware threads
+    for (int readers = 1; readers <= maxThreads; readers = readers == maxThreads ? readers + 1 : min(2 * readers, maxThreads)) {
+        double lockFree = readerThroughput(readers, true, 0.5);
+        double locked = readerThroughput(readers, false, 0.5);
+        cout << setw(8) << readers << setw(16) << fixed << setprecision(0) << lockFree << setw(16) << locked << endl;
+    }
+}
+
+const char *policyName(prob_t policy) {
+    switch (policy) {
+        case QUADRATIC:
+            return "QUADRATIC";
+        case DOUBLEHASH:
+            return "DOUBLEHASH";
+        case LINEAR:
+            return "LINEAR";
+    }
+    return "";
+}
+
+// average nanoseconds per getPatient() for patients that are not in the table
+double missLatency(const VacDB &vacdb, const vector<Patient> &missing) {
+    const int rounds = 50;
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (const Patient &patient: missing) {
+            vacdb.getPatient(patient.getKey(), patient.getSerial());
+        }
+    }
+    return secondsSince(start) * 1e9 / (double(rounds) * missing.size());
+}
+
+void benchMigrationMisses() {
+    cout << "Miss latency during an incremental rehash (ns per getPatient, share of old probes skipped)" << endl;
+    vector<Patient> patients = makePatients(20000, 3);
+    vector<Patient> missing = makePatients(5000, 4);
+
+    for (prob_t policy: {QUADRATIC, DOUBLEHASH, LINEAR}) {
+        VacDB vacdb(MINPRIME, hashCode, policy);
+        size_t next = 0;
+        for (; next < 12000; next++) {
+            vacdb.insert(patients[next]);
+        }
+        double idle = missLatency(vacdb, missing);
+
+        //keep inserting until the next rehash starts, the first quarter of the old table is then transferred
+        while (vacdb.rehashInProgress()) {
+            vacdb.insert(patients[next++]);
+        }
+        while (!vacdb.rehashInProgress()) {
+            vacdb.insert(patients[next++]);
+        }
+
+        cout << setw(12) << policyName(policy) << "  idle " << fixed << setprecision(1) << idle;
+        for (int stage = 25; vacdb.rehashInProgress(); stage += 25) {
+            long skippedBefore = vacdb.getStats().oldProbesSkipped;
+            double latency = missLatency(vacdb, missing);
+            double skipped = double(vacdb.getStats().oldProbesSkipped - skippedBefore) / (50.0 * missing.size());
+            cout << "  " << stage << "%: " << latency << " (" << setprecision(0) << 100 * skipped << "%)"
+                 << setprecision(1);
+            //a rejected duplicate still advances the transfer by one step
+            vacdb.insert(patients[0]);
+        }
+        cout << endl;
+    }
+}
+
+void benchNegativeFilter() {
+    cout << "Negative-lookup filter (ns per operation)" << endl;
+    cout << setw(12) << "policy" << setw(8) << "filter" << setw(12) << "insert" << setw(12) << "miss"
+         << setw(12) << "hit" << setw(10) << "fp rate" << setw(12) << "bytes" << endl;
+    vector<Patient> patients = makePatients(24000, 5);
+    vector<Patient> missing = makePatients(5000, 6);
+
+    for (prob_t policy: {QUADRATIC, DOUBLEHASH, LINEAR}) {
+        for (bool filter: {false, true}) {
+            VacDB vacdb(MINPRIME, hashCode, policy);
+            if (filter) {
+                vacdb.enableNegativeFilter(10);
+            }
+            auto start = chrono::steady_clock::now();
+            for (Patient &patient: patients) {
+                vacdb.insert(patient);
+            }
+            double insert = secondsSince(start) * 1e9 / patients.size();
+
+            VacDBStats before = vacdb.getStats();
+            double miss = missLatency(vacdb, missing);
+            VacDBStats after = vacdb.getStats();
+            long negatives = after.filterNegatives - before.filterNegatives;
+            long falsePositives = after.filterFalsePositives - before.filterFalsePositives;
+
+            start = chrono::steady_clock::now();
+            for (Patient &patient: patients) {
+                vacdb.getPatient(patient.getKey(), patient.getSerial());
+            }
+            double hit = secondsSince(start) * 1e9 / patients.size();
+
+            cout << setw(12) << policyName(policy) << setw(8) << (filter ? "on" : "off") << fixed << setprecision(1)
+                 << setw(12) << insert << setw(12) << miss << setw(12) << hit << setprecision(4) << setw(10)
+                 << (filter ? double(falsePositives) / double(negatives + falsePositives) : 1.0)
+                 << setw(12) << after.filterBytes << endl;
+        }
+    }
+}
+
+// microseconds per insert + remove pair of the churn set, starting at patient first
+vector<double> writeLatencies(VacDB &vacdb, const vector<Patient> &churn, int first, int count) {
+    vector<double> latencies;
+    latencies.reserve(count);
+    for (int i = first; i < first + count; i++) {
+        auto start = chrono::steady_clock::now();
+        vacdb.insert(churn[i % churn.size()]);
+        vacdb.remove(churn[(i + churn.size() / 2) % churn.size()]);
+        latencies.push_back(secondsSince(start) * 1e6);
+    }
+    return latencies;
+}
+
+void benchCheckpoint() {
+    cout << "Online checkpoint (write latency in microseconds per insert + remove)" << endl;
+    vector<Patient> patients = makePatients(20000, 7);
+    vector<Patient> churn = makePatients(4000, 8);
+    VacDB vacdb(MINPRIME, hashCode, DOUBLEHASH);
+    for (Patient &patient: patients) {
+        vacdb.insert(patient);
+    }
+
+    vector<double> idle = writeLatencies(vacdb, churn, 0, 4000);
+    if (!vacdb.startCheckpoint("bench_checkpoint.bin")) {
+        cout << "checkpoint could not be started" << endl;
+        return;
+    }
+    //the writes right after the fork pay for the copy-on-write page faults
+    vector<double> during = writeLatencies(vacdb, churn, 4000, 4000);
+    CheckpointStats stats = vacdb.finishCheckpoint();
+    std::remove("bench_checkpoint.bin");
+
+    cout << setw(10) << "" << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "max" << endl;
+    cout << fixed << setprecision(2);
+    cout << setw(10) << "idle" << setw(10) << percentile(idle, 0.5) << setw(10) << percentile(idle, 0.99)
+         << setw(10) << percentile(idle, 1) << endl;
+    cout << setw(10) << "during" << setw(10) << percentile(during, 0.5) << setw(10) << percentile(during, 0.99)
+         << setw(10) << percentile(during, 1) << endl;
+    cout << "snapshot pause " << stats.pauseSeconds * 1e6 << " us, " << stats.bytes << " bytes in "
+         << stats.seconds * 1e3 << " ms (" << stats.megabytesPerSecond << " MB/s)"
+         << (stats.success ? "" : " FAILED") << endl;
+}
+
+// runs work() once under the hardware counters and prints one row of per-operation costs
+template<class Work>
+void countedPhase(PerfCounters &counters, prob_t policy, const char *phase, long numOps, Work work) {
+    auto start = chrono::steady_clock::now();
+    counters.start();
+    work();
+    counters.stop();
+    double nanos = secondsSince(start) * 1e9;
+    cout << setw(11) << policyName(policy) << setw(8) << phase << setw(9) << fixed << setprecision(1)
+         << nanos / numOps;
+    for (int c = CYCLES; c < NUMCOUNTERS; c++) {
+        double value = counters.value(counter_t(c));
+        if (value < 0) {
+            cout << setw(11) << "n/a";
+        } else {
+            cout << setw(11) << setprecision(c <= INSTRUCTIONS ? 1 : 3) << value / numOps;
+        }
+    }
+    double cycles = counters.value(CYCLES), instructions = counters.value(INSTRUCTIONS);
+    if (cycles > 0 && instructions >= 0) {
+        cout << setw(7) << setprecision(2) << instructions / cycles;
+    } else {
+        cout << setw(7) << "n/a";
+    }
+    cout << endl;
+}
+
+// hardware events per operation for every probing policy: inserts from an empty table
+// (including the incremental rehashes), successful lookups, misses and removes
+void benchHardwareCounters() {
+    const int numPatients = 20000;
+    const int rounds = 5;
+    vector<Patient> patients = makePatients(numPatients, 1);
+    vector<Patient> missing = makePatients(numPatients, 3);
+    PerfCounters counters;
+
+    cout << "Hardware counters per operation (" << numPatients << " patients)" << endl;
+    if (!counters.available()) {
+        cout << "hardware counters unavailable (" << counters.error() << "), wall-clock time only" << endl;
+    } else if (!counters.error().empty()) {
+        cout << "some counters unavailable (" << counters.error() << ")" << endl;
+    }
+    cout << setw(11) << "policy" << setw(8) << "phase" << setw(9) << "ns";
+    for (int c = CYCLES; c < NUMCOUNTERS; c++) {
+        cout << setw(11) << PerfCounters::name(counter_t(c));
+    }
+    cout << setw(7) << "IPC" << endl;
+
+    for (prob_t policy: {QUADRATIC, DOUBLEHASH, LINEAR}) {
+        VacDB vacdb(MINPRIME, hashCode, policy);
+        countedPhase(counters, policy, "insert", numPatients, [&]() {
+            for (Patient &patient: patients) {
+                vacdb.insert(patient);
+            }
+        });
+        countedPhase(counters, policy, "hit", long(rounds) * numPatients, [&]() {
+            for (int r = 0; r < rounds; r++) {
+                for (Patient &patient: patients) {
+                    vacdb.getPatient(patient.getKey(), patient.getSerial());
+                }
+            }
+        });
+        countedPhase(counters, policy, "miss", long(rounds) * numPatients, [&]() {
+            for (int r = 0; r < rounds; r++) {
+                for (Patient &patient: missing) {
+                    vacdb.getPatient(patient.getKey(), patient.getSerial());
+                }
+            }
+        });
+        countedPhase(counters, policy, "remove", numPatients, [&]() {
+            for (Patient &patient: patients) {
+                vacdb.remove(patient);
+            }
+        });
+    }
+}
+
+const char *pagesName(page_t pages) {
+    switch (pages) {
+        case STANDARDPAGES:
+            return "4k";
+        case TRANSPARENTHUGEPAGES:
+            return "THP";
+        case EXPLICITHUGEPAGES:
+            return "hugetlb";
+    }
+    return "";
+}
+
+// lookup latency on the largest table (MAXPRIME slots) for every slot array allocation
+void benchTablePages() {
+    const int numPatients = 24000;
+    vector<Patient> patients = makePatients(numPatients, 7);
+    vector<Patient> missing = makePatients(numPatients, 8);
+    vector<Patient> shuffled = patients;
+    shuffle(shuffled.begin(), shuffled.end(), mt19937(9));
+
+    cout << "Slot array pages (" << MAXPRIME << " slots, " << numPatients << " patients, ns per lookup)" << endl;
+    cout << setw(10) << "requested" << setw(12) << "numa" << setw(10) << "got" << setw(12) << "table bytes"
+         << setw(10) << "hit" << setw(10) << "miss" << endl;
+    for (numa_t numa: {FIRSTTOUCH, INTERLEAVE}) {
+        for (page_t pages: {STANDARDPAGES, TRANSPARENTHUGEPAGES, EXPLICITHUGEPAGES}) {
+            VacDB vacdb(MAXPRIME, hashCode, DOUBLEHASH);
+            AllocationPolicy policy;
+            policy.pages = pages;
+            policy.numa = numa;
+            vacdb.setAllocationPolicy(policy);
+            for (Patient &patient: patients) {
+                vacdb.insert(patient);
+            }
+
+            const int rounds = 20;
+            auto start = chrono::steady_clock::now();
+            for (int r = 0; r < rounds; r++) {
+                for (Patient &patient: shuffled) {
+                    vacdb.getPatient(patient.getKey(), patient.getSerial());
+                }
+            }
+            double hit = secondsSince(start) * 1e9 / (double(rounds) * shuffled.size());
+            double miss = missLatency(vacdb, missing);
+
+            cout << setw(10) << pagesName(pages) << setw(12) << (numa == FIRSTTOUCH ? "first-touch" : "interleave")
+                 << setw(10) << pagesName(vacdb.getStats().tablePages) << setw(12)
+                 << vacdb.footprint() - numPatients * sizeof(Patient) - sizeof(VacDB) << fixed << setprecision(1)
+                 << setw(10) << hit << setw(10) << miss << endl;
+        }
+    }
+}
+
+// a hash with few effective bits, so that home slots cluster
+unsigned int weakHash(const string str) {
+    unsigned int val = 0;
+    for (char c: str) {
+        val = val * 2 + (unsigned char) c;
+    }
+    return val;
+}
+
+// fixed policies against adaptive probing on key sets that favour different policies:
+// inserts from an empty table, then lookups of which one in five misses
+void benchAdaptiveProbing() {
+    const int numPatients = 24000;
+    const int rounds = 5;
+    struct KeySet{
+        const char *name;
+        hash_fn hash;
+        vector<Patient> patients, missing;
+    };
+    vector<KeySet> keySets(3);
+    keySets[0] = {"random", hashCode, makePatients(numPatients, 10), makePatients(numPatients / 4, 11)};
+    keySets[1] = {"sequential", hashCode, {}, {}};
+    keySets[2] = {"weak hash", weakHash, makePatients(numPatients, 10), makePatients(numPatients / 4, 11)};
+    for (int i = 0; i < numPatients + numPatients / 4; i++) {
+        string name = to_string(1000000 + i);
+        (i < numPatients ? keySets[1].patients : keySets[1].missing).push_back(Patient("p" + name, MINID, true));
+    }
+
+    cout << "Adaptive probing (ns per operation)" << endl;
+    cout << setw(12) << "keys" << setw(12) << "policy" << setw(10) << "insert" << setw(10) << "lookup"
+         << "   decision" << endl;
+    for (KeySet &keySet: keySets) {
+        for (int mode = 0; mode < 4; mode++) {
+            bool adaptive = mode == 3;
+            VacDB vacdb(MINPRIME, keySet.hash, adaptive ? DEFPOLCY : prob_t(mode));
+            vacdb.setAdaptiveProbing(adaptive);
+            auto start = chrono::steady_clock::now();
+            for (Patient &patient: keySet.patients) {
+                vacdb.insert(patient);
+            }
+            double insert = secondsSince(start) * 1e9 / keySet.patients.size();
+
+            start = chrono::steady_clock::now();
+            long lookups = 0;
+            for (int r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < keySet.patients.size(); i++, lookups++) {
+                    //every fifth lookup is for an absent patient
+                    const Patient &patient = i % 5 == 4 ? keySet.missing[(i / 5) % keySet.missing.size()]
+                                                        : keySet.patients[i];
+                    vacdb.getPatient(patient.getKey(), patient.getSerial());
+                }
+            }
+            double lookup = secondsSince(start) * 1e9 / lookups;
+
+            cout << setw(12) << keySet.name << setw(12) << (adaptive ? "ADAPTIVE" : policyName(prob_t(mode)))
+                 << fixed << setprecision(1) << setw(10) << insert << setw(10) << lookup;
+            if (adaptive) {
+                VacDBStats stats = vacdb.getStats();
+                const ProbingDecision &decision = stats.lastProbingDecision;
+                cout << "   " << policyName(decision.chosen) << " after " << stats.probingDecisions
+                     << " rehashes, predicted Q/D/L " << setprecision(2) << decision.predictedCost[QUADRATIC] << "/"
+                     << decision.predictedCost[DOUBLEHASH] << "/" << decision.predictedCost[LINEAR];
+            }
+            cout << endl;
+        }
+    }
+}
+
+// rebuild time after a bulk delete: the incremental rehash the delete threshold starts, run to
+// completion, against rehashNow() with 1, 2, 4, ... workers on the same table a remove earlier
+void benchRebuild() {
+    const int numPatients = 24000;
+    vector<Patient> patients = makePatients(numPatients, 12);
+    int maxThreads = max(4, int(thread::hardware_concurrency()));
+
+    cout << "Rebuild after a bulk delete of " << numPatients << " patients (ms)" << endl;
+    cout << setw(12) << "policy" << setw(8) << "live" << setw(13) << "incremental";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        cout << setw(7) << threads << "T";
+    }
+    cout << setw(10) << "deferred" << endl;
+    for (prob_t policy: {QUADRATIC, DOUBLEHASH, LINEAR}) {
+        //removes patients until the next remove would start a rehash
+        int numRemoved = 0;
+        auto build = [&]() {
+            unique_ptr<VacDB> vacdb(new VacDB(MINPRIME, hashCode, policy));
+            for (Patient &patient: patients) {
+                vacdb->insert(patient);
+            }
+            vacdb->reserve(0);
+            for (int i = 0; i < numRemoved; i++) {
+                vacdb->remove(patients[i]);
+            }
+            return vacdb;
+        };
+        unique_ptr<VacDB> probe = build();
+        while (!probe->rehashInProgress()) {
+            probe->remove(patients[numRemoved++]);
+        }
+        numRemoved--;
+
+        unique_ptr<VacDB> vacdb = build();
+        auto start = chrono::steady_clock::now();
+        vacdb->remove(patients[numRemoved]);
+        vacdb->reserve(0);
+        double incremental = secondsSince(start) * 1e3;
+        cout << setw(12) << policyName(policy) << setw(8) << numPatients - numRemoved << fixed << setprecision(2)
+             << setw(13) << incremental;
+
+        long deferred = 0;
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            vacdb = build();
+            start = chrono::steady_clock::now();
+            vacdb->rehashNow(threads);
+            cout << setw(8) << secondsSince(start) * 1e3;
+            deferred = vacdb->getStats().parallelDeferred;
+        }
+        cout << setw(10) << deferred << endl;
+    }
+}
+
+// lookup cost of hot hits, cold hits and misses once the coldest patients are demoted to a
+// memory-mapped segment, the memory the demotion gives back, and the write cost of demoting
+// in many small steps
+void benchTiers() {
+    const int numPatients = 24000;
+    const int lookups = 200000;
+    vector<Patient> patients = makePatients(numPatients, 13);
+    vector<Patient> missing = makePatients(numPatients, 14);
+
+    cout << "Tiered storage with " << numPatients << " patients (ns per lookup)" << endl;
+    cout << setw(8) << "cold%" << setw(10) << "hot" << setw(10) << "cold" << setw(10) << "miss" << setw(12)
+         << "saved KiB" << setw(12) << "mapped KiB" << endl;
+    for (double fraction: {0.0, 0.5, 0.9}) {
+        VacDB vacdb(MINPRIME, hashCode, QUADRATIC);
+        vacdb.enableTiering("/tmp/vacdb_bench.cold");
+        for (Patient &patient: patients) {
+            vacdb.insert(patient);
+        }
+        //patients are inserted in order, so the first ones are the coldest
+        int numCold = int(numPatients * fraction);
+        vacdb.demoteColdest(numCold);
+        auto lookupNs = [&](int first, int count, const vector<Patient> &from) {
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < lookups; i++) {
+                const Patient &patient = from[first + i % count];
+                vacdb.getPatient(patient.getKey(), patient.getSerial());
+            }
+            return secondsSince(start) * 1e9 / lookups;
+        };
+        double cold = numCold > 0 ? lookupNs(0, numCold, patients) : 0;
+        double hot = lookupNs(numCold, numPatients - numCold, patients);
+        double miss = lookupNs(0, numPatients, missing);
+        TierStats stats = vacdb.getTierStats();
+        cout << setw(8) << int(fraction * 100) << fixed << setprecision(1) << setw(10) << hot << setw(10) << cold
+             << setw(10) << miss << setw(12) << stats.memorySavedBytes / 1024 << setw(12)
+             << stats.coldFileBytes / 1024 << endl;
+    }
+
+    //each step only writes its own run; merges rewrite every cold patient O(log n) times in all
+    VacDB vacdb(MINPRIME, hashCode, QUADRATIC);
+    vacdb.enableTiering("/tmp/vacdb_bench.cold");
+    for (Patient &patient: patients) {
+        vacdb.insert(patient);
+    }
+    const int steps = 90;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        vacdb.demoteColdest(numPatients / 100);
+    }
+    TierStats stats = vacdb.getTierStats();
+    cout << steps << " demotions of 1%: " << fixed << setprecision(2) << secondsSince(start) * 1e3 / steps
+         << " ms each, " << stats.mergedPatients << " patients rewritten by merges, " << stats.coldRuns << " runs"
+         << endl;
+}
+
+// write cost of the aggregate counters (insert and remove of every patient, ns per operation) and
+// reporting cost of one name and one serial count with them against the parallel scans
+void benchAggregates() {
+    const int numPatients = 24000;
+    const int rounds = 5;
+    vector<Patient> patients = makePatients(numPatients, 15);
+
+    cout << "Aggregates over " << numPatients << " patients" << endl;
+    cout << setw(12) << "aggregates" << setw(10) << "insert" << setw(10) << "remove" << setw(14) << "report ns"
+         << endl;
+    for (bool aggregates: {false, true}) {
+        double insert = 0, remove = 0;
+        for (int round = 0; round < rounds; round++) {
+            VacDB vacdb(MINPRIME, hashCode, QUADRATIC);
+            if (aggregates) {
+                vacdb.enableAggregates();
+            }
+            auto start = chrono::steady_clock::now();
+            for (Patient &patient: patients) {
+                vacdb.insert(patient);
+            }
+            insert += secondsSince(start) * 1e9 / numPatients / rounds;
+            start = chrono::steady_clock::now();
+            for (Patient &patient: patients) {
+                vacdb.remove(patient);
+            }
+            remove += secondsSince(start) * 1e9 / numPatients / rounds;
+        }
+
+        VacDB vacdb(MINPRIME, hashCode, QUADRATIC);
+        for (Patient &patient: patients) {
+            vacdb.insert(patient);
+        }
+        if (aggregates) {
+            vacdb.enableAggregates();
+        }
+        const int reports = aggregates ? 100000 : 20;
+        long sink = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < reports; i++) {
+            const Patient &patient = patients[i % numPatients];
+            if (aggregates) {
+                sink += vacdb.countOfName(patient.getKey()) + vacdb.countOfSerial(patient.getSerial());
+            } else {
+                sink += vacdb.countByName()[patient.getKey()] + vacdb.countBySerial()[patient.getSerial()];
+            }
+        }
+        double report = secondsSince(start) * 1e9 / reports;
+        cout << setw(12) << (aggregates ? "on" : "off") << fixed << setprecision(1) << setw(10) << insert
+             << setw(10) << remove << setw(14) << report << (sink < 0 ? "!" : "") << endl;
+    }
+}
+
+// records per second written to /dev/null by dump() (which prints every slot) and by exportPatients()
+// in each format with 1, 2, 4, ... formatting threads, averaged over several exports
+void benchExport() {
+    const int numPatients = 24000;
+    const int rounds = 20;
+    vector<Patient> patients = makePatients(numPatients, 16);
+    VacDB vacdb(MINPRIME, hashCode, QUADRATIC);
+    for (Patient &patient: patients) {
+        vacdb.insert(patient);
+    }
+    vacdb.reserve(0);
+    int devNull = open("/dev/null", O_WRONLY);
+    int maxThreads = max(4, int(thread::hardware_concurrency()));
+
+    cout << "Export of " << numPatients << " patients to /dev/null (million records/s)" << endl;
+    ofstream nullStream("/dev/null");
+    streambuf *console = cout.rdbuf(nullStream.rdbuf());
+    auto start = chrono::steady_clock::now();
+    vacdb.dump();
+    double dump = numPatients / secondsSince(start) / 1e6;
+    cout.rdbuf(console);
+    cout << setw(10) << "dump()" << fixed << setprecision(2) << setw(8) << dump << endl;
+
+    cout << setw(10) << "format";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        cout << setw(7) << threads << "T";
+    }
+    cout << setw(10) << "MB/round" << endl;
+    for (export_t format: {EXPORTCSV, EXPORTJSONL, EXPORTBINARY}) {
+        cout << setw(10) << (format == EXPORTCSV ? "csv" : format == EXPORTJSONL ? "jsonl" : "binary");
+        size_t bytes = 0;
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            ExportOptions options;
+            options.format = format;
+            options.numThreads = threads;
+            start = chrono::steady_clock::now();
+            long records = 0;
+            for (int round = 0; round < rounds; round++) {
+                ExportStats stats = vacdb.exportPatients(fdSink(devNull), options);
+                records += stats.records;
+                bytes = stats.bytes;
+            }
+            cout << setw(8) << records / secondsSince(start) / 1e6;
+        }
+        cout << setw(10) << bytes / 1e6 << endl;
+    }
+    close(devNull);
+}
+
+// operations per second of numThreads threads that each insert, look up twice and remove their own
+// patients, every call either under a reader-writer lock (lookups shared) or through a VacDBCombiner
+// meanBatch receives the mean number of operations per combined batch
+double producerThroughput(int numThreads, bool combining, const vector<Patient> &patients, double seconds,
+                          double *meanBatch = nullptr) {
+    VacDB vacdb(MINPRIME, hashCode, QUADRATIC);
+    VacDBCombiner combiner(vacdb, 64);
+    shared_mutex lock;
+    atomic<bool> stop(false);
+    atomic<long> operations(0);
+    int perThread = int(patients.size()) / numThreads;
+
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            long count = 0;
+            auto call = [&](combine_op_t op, const Patient &patient) {
+                if (combining) {
+                    combiner.execute({op, patient});
+                } else if (op == COMBINEGET) {
+                    shared_lock<shared_mutex> guard(lock);
+                    vacdb.getPatient(patient.getKey(), patient.getSerial());
+                } else {
+                    unique_lock<shared_mutex> guard(lock);
+                    op == COMBINEINSERT ? vacdb.insert(patient) : vacdb.remove(patient);
+                }
+                count++;
+            };
+            const Patient *own = &patients[t * perThread];
+            while (!stop.load(memory_order_relaxed)) {
+                for (int i = 0; i < perThread; i++) call(COMBINEINSERT, own[i]);
+                for (int i = 0; i < 2 * perThread; i++) call(COMBINEGET, own[i % perThread]);
+                for (int i = 0; i < perThread; i++) call(COMBINEREMOVE, own[i]);
+            }
+            operations += count;
+        });
+    }
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    for (thread &worker: threads) {
+        worker.join();
+    }
+    if (meanBatch != nullptr) {
+        CombinerStats stats = combiner.getStats();
+        *meanBatch = stats.batches > 0 ? double(stats.operations) / stats.batches : 0;
+    }
+    return operations / seconds;
+}
+
+void benchCombining() {
+    vector<Patient> patients = makePatients(12800, 17);
+    cout << "Producer threads, operations per second (insert/get/get/remove)" << endl;
+    cout << setw(8) << "threads" << setw(14) << "rwlock" << setw(14) << "combining" << setw(8) << "batch" << endl;
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        double meanBatch = 0;
+        double locked = producerThroughput(threads, false, patients, 0.5);
+        double combined = producerThroughput(threads, true, patients, 0.5, &meanBatch);
+        cout << setw(8) << threads << fixed << setprecision(0) << setw(14) << locked << setw(14) << combined
+             << setprecision(2) << setw(8) << meanBatch << endl;
+    }
+}
+
+// a primary inserting patients and removing every other one while a replica thread applies the
+// stream over a Unix socket (changes per second, lag of the frames), and the cost of applying runs
+// of inserts with insertBulk() against one insert() each
+void benchReplication() {
+    const int numPatients = 24000;
+    const string path = "/tmp/vacdb_bench_replication.sock";
+    vector<Patient> patients = makePatients(numPatients, 18);
+
+    cout << "Replication of " << numPatients << " inserts and " << numPatients / 2 << " removes" << endl;
+    cout << setw(8) << "batch" << setw(14) << "changes/s" << setw(14) << "mean lag us" << setw(14)
+         << "max lag us" << setw(10) << "frames" << endl;
+    for (int batch: {1, 16, 256}) {
+        VacDB primaryDatabase(MINPRIME, hashCode, QUADRATIC);
+        unique_ptr<ReplicationPrimary> primary(new ReplicationPrimary(primaryDatabase, batch));
+        primary->listenUnix(path);
+        VacDB replicaDatabase(MINPRIME, hashCode, QUADRATIC);
+        ReplicationReplica replica(replicaDatabase);
+        replica.connectUnix(path);
+        //the follower runs until the primary goes away
+        thread follower([&replica]() {
+            while (replica.poll(10)) {
+            }
+        });
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < numPatients; i++) {
+            primaryDatabase.insert(patients[i]);
+            if (i % 2 == 1) {
+                primaryDatabase.remove(patients[i - 1]);
+            }
+            if (i % 1024 == 0) {
+                primary->poll(0);
+            }
+        }
+        PrimaryStats stats;
+        do {
+            primary->poll(1);
+            stats = primary->getStats();
+        } while (stats.replicas == 0 || stats.minAcked < stats.sequence);
+        double seconds = secondsSince(start);
+        primary.reset();
+        follower.join();
+
+        ReplicaStats replicaStats = replica.getStats();
+        cout << setw(8) << batch << fixed << setprecision(0) << setw(14) << stats.sequence / seconds << setw(14)
+             << replicaStats.meanLagMicros << setw(14) << replicaStats.maxLagMicros << setw(10) << stats.frames
+             << endl;
+    }
+
+    //the replica applies the runs of inserts of a frame either way
+    cout << setw(8) << "run" << setw(14) << "insert() ns" << setw(14) << "insertBulk ns" << endl;
+    for (int run: {256, 1024, 4096}) {
+        double seconds[2] = {0, 0};
+        for (int bulk = 0; bulk < 2; bulk++) {
+            VacDB vacdb(MINPRIME, hashCode, QUADRATIC);
+            auto start = chrono::steady_clock::now();
+            for (int first = 0; first < numPatients; first += run) {
+                vector<Patient> frame(patients.begin() + first, patients.begin() + min(numPatients, first + run));
+                if (bulk) {
+                    vacdb.insertBulk(frame);
+                } else {
+                    for (Patient &patient: frame) {
+                        vacdb.insert(patient);
+                    }
+                }
+            }
+            seconds[bulk] = secondsSince(start);
+        }
+        cout << setw(8) << run << fixed << setprecision(1) << setw(14) << seconds[0] * 1e9 / numPatients << setw(14)
+             << seconds[1] * 1e9 / numPatients << endl;
+    }
+}
+
+// count patients whose names all have the same hashCode: every name is a string of two-letter
+// blocks "aB" or "b!", which add the same amount to the hash ('a' * 33 + 'B' == 'b' * 33 + '!')
+vector<Patient> makeCollidingPatients(int count, int seed) {
+    mt19937 generator(seed);
+    uniform_int_distribution<> serial(MINID, MAXID);
+    vector<Patient> patients;
+    patients.reserve(count);
+    for (int i = 0; i < count; i++) {
+        string name;
+        for (int bit = 0; bit < 16; bit++) {
+            name += (i >> bit & 1) ? "b!" : "aB";
+        }
+        patients.push_back(Patient(name, serial(generator), true));
+    }
+    return patients;
+}
+
+// nanoseconds per insert and per lookup of random and of hashCode-colliding names under each policy,
+// with the longest probe sequence left in the table and the rebuilds the chain guard needed for it
+void benchChains() {
+    const int numPatients = 20000;
+    const int rounds = 5;
+    cout << "Probe-chain guard, " << numPatients << " patients" << endl;
+    cout << setw(10) << "names" << setw(12) << "policy" << setw(10) << "insert" << setw(10) << "lookup"
+         << setw(9) << "longest" << setw(7) << "limit" << setw(8) << "alarms" << setw(8) << "reseeds"
+         << setw(10) << "fallback" << endl;
+    for (int colliding = 0; colliding < 2; colliding++) {
+        vector<Patient> patients = colliding ? makeCollidingPatients(numPatients, 17) : makePatients(numPatients, 17);
+        for (prob_t policy: {QUADRATIC, DOUBLEHASH, LINEAR}) {
+            VacDB vacdb(MINPRIME, hashCode, policy);
+            auto start = chrono::steady_clock::now();
+            for (Patient &patient: patients) {
+                vacdb.insert(patient);
+            }
+            double insert = secondsSince(start) * 1e9 / numPatients;
+            start = chrono::steady_clock::now();
+            long found = 0;
+            for (int round = 0; round < rounds; round++) {
+                for (Patient &patient: patients) {
+                    found += vacdb.getPatient(patient.getKey(), patient.getSerial()).getUsed();
+                }
+            }
+            double lookup = secondsSince(start) * 1e9 / (double(rounds) * numPatients);
+            VacDBStats stats = vacdb.getStats();
+            cout << setw(10) << (colliding ? "colliding" : "random")
+                 << setw(12) << (policy == QUADRATIC ? "quadratic" : policy == DOUBLEHASH ? "doublehash" : "linear")
+                 << fixed << setprecision(0) << setw(10) << insert << setw(10) << lookup
+                 << (found == long(rounds) * vacdb.numPatients() ? "" : "!") << setw(9) << stats.longestChain
+                 << setw(7) << stats.chainLimit << setw(8) << stats.chainAlarms << setw(8) << stats.reseeds
+                 << setw(10) << stats.policyFallbacks << endl;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    string mode = argc > 1 ? argv[1] : "all";
+    bool all = mode == "all";
+
+    if (all || mode == "readers") {
+        benchReaderScaling();
+    }
+    if (all || mode == "migration") {
+        benchMigrationMisses();
+    }
+    if (all || mode == "filter") {
+        benchNegativeFilter();
+    }
+    if (all || mode == "checkpoint") {
+        benchCheckpoint();
+    }
+    if (all || mode == "counters") {
+        benchHardwareCounters();
+    }
+    if (all || mode == "pages") {
+        benchTablePages();
+    }
+    if (all || mode == "adaptive") {
+        benchAdaptiveProbing();
+    }
+    if (all || mode == "rebuild") {
+        benchRebuild();
+    }
+    if (all || mode == "tiers") {
+        benchTiers();
+    }
+    if (all || mode == "aggregates") {
+        benchAggregates();
+    }
+    if (all || mode == "export") {
+        benchExport();
+    }
+    if (all || mode == "combining") {
+        benchCombining();
+    }
+    if (all || mode == "replication") {
+        benchReplication();
+    }
+    if (all || mode == "chains") {
+        benchChains();
+    }
+    return 0;
+}
+
+unsigned int hashCode(const string str) {
+    unsigned int val = 0;
+    const unsigned int thirtyThree = 33;  // magic number from textbook
+    for (unsigned int i = 0; i < str.length(); i++)
+        val = val * thirtyThree + str[i];
+    return val;
+}
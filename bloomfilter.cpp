@@ -0,0 +1,61 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "bloomfilter.h"
+#include <algorithm>
+#include <cmath>
+
+BloomFilter::BloomFilter(int numEntries, int bitsPerEntry) {
+    //round up to whole blocks, the optimal number of hashes is bitsPerEntry * ln 2
+    uint64_t numBits = uint64_t(max(numEntries, 1)) * max(bitsPerEntry, 1);
+    m_numBlocks = max<uint64_t>(1, (numBits + 64 * BLOCKWORDS - 1) / (64 * BLOCKWORDS));
+    m_words.assign(m_numBlocks * BLOCKWORDS, 0);
+    m_numHashes = min(MAXHASHES, max(1, int(round(bitsPerEntry * log(2.0)))));
+}
+
+uint64_t BloomFilter::hashKey(const string &key, int serial) {
+    //FNV-1a over the name, then the serial number, finished with the splitmix64 mixer
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c: key) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    hash ^= uint64_t(uint32_t(serial)) * 0x9E3779B97F4A7C15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+uint64_t *BloomFilter::block(uint64_t hash) const {
+    //the high half picks the block without a division
+    uint64_t index = ((hash >> 32) * m_numBlocks) >> 32;
+    return const_cast<uint64_t *>(&m_words[index * BLOCKWORDS]);
+}
+
+void BloomFilter::add(const string &key, int serial) {
+    uint64_t hash = hashKey(key, serial);
+    uint64_t *words = block(hash);
+    //every group of 9 bits of the remixed hash selects one bit of the block
+    uint64_t bits = hash * 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < m_numHashes; i++, bits >>= 9) {
+        uint64_t *word = &words[(bits & 511) / 64];
+        //only one thread adds, so a plain read-modify-write published atomically is enough
+        __atomic_store_n(word, __atomic_load_n(word, __ATOMIC_RELAXED) | (uint64_t(1) << (bits & 63)),
+                         __ATOMIC_RELAXED);
+    }
+}
+
+bool BloomFilter::mayContain(const string &key, int serial) const {
+    uint64_t hash = hashKey(key, serial);
+    const uint64_t *words = block(hash);
+    uint64_t bits = hash * 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < m_numHashes; i++, bits >>= 9) {
+        if ((__atomic_load_n(&words[(bits & 511) / 64], __ATOMIC_RELAXED) & (uint64_t(1) << (bits & 63))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double BloomFilter::falsePositiveRate(int numEntries) const {
+    //(1 - e^(-kn/m))^k, ignoring the small penalty of uneven block loads
+    double numBits = double(m_numBlocks) * 64 * BLOCKWORDS;
+    return pow(1 - exp(-double(m_numHashes) * numEntries / numBits), m_numHashes);
+}
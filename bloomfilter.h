@@ -0,0 +1,31 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+// Blocked Bloom filter over (name, serial) pairs used to answer "definitely
+// absent" before a hash table is probed. All bits of a key fall into one
+// 64-byte block, so a query touches a single cache line. Entries cannot be
+// removed; the filter of a table is rebuilt when the table is rehashed.
+// add() is for a single writer and may run concurrently with mayContain().
+class BloomFilter{
+public:
+    // sized for numEntries entries with bitsPerEntry bits each
+    BloomFilter(int numEntries, int bitsPerEntry);
+    void add(const string& key, int serial);
+    bool mayContain(const string& key, int serial) const;
+    size_t memoryBytes() const {return m_words.size() * sizeof(uint64_t);}
+    // false-positive rate expected after numEntries distinct additions
+    double falsePositiveRate(int numEntries) const;
+private:
+    static constexpr int BLOCKWORDS = 8;    // 512-bit blocks
+    static constexpr int MAXHASHES = 7;     // bit positions per key (9 hash bits each)
+    static uint64_t hashKey(const string& key, int serial);
+    uint64_t* block(uint64_t hash) const;
+    vector<uint64_t> m_words;
+    uint64_t m_numBlocks;
+    int m_numHashes;
+};
+#endif
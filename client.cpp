@@ -0,0 +1,121 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "client.h"
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+VacDBClient::VacDBClient() : m_fd(-1), m_nextId(1), m_inUsed(0) {}
+
+VacDBClient::~VacDBClient() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool VacDBClient::connectUnix(const string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return m_fd >= 0 && connect(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+}
+
+bool VacDBClient::connectTcp(int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    m_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int noDelay = 1;
+    return m_fd >= 0 && setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) == 0 &&
+           connect(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+}
+
+uint32_t VacDBClient::send(op_t op, const vector<Patient> &patients, int newSerial) {
+    Request request;
+    request.op = op;
+    request.id = m_nextId++;
+    request.newSerial = newSerial;
+    request.patients = patients;
+    if (!encodeRequest(request, m_out)) {
+        return 0;
+    }
+    m_pending.push_back(op);
+    return request.id;
+}
+
+bool VacDBClient::flush() {
+    for (size_t sent = 0; sent < m_out.size();) {
+        ssize_t result = ::send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno != EINTR) {
+            return false;
+        }
+        sent += max<ssize_t>(result, 0);
+    }
+    m_out.clear();
+    return true;
+}
+
+bool VacDBClient::receive(Response &response) {
+    if (m_pending.empty() || !flush()) {
+        return false;
+    }
+    char buffer[1 << 16];
+    while (true) {
+        long length = decodeResponse(m_pending.front(), m_in.data() + m_inUsed, m_in.size() - m_inUsed, response);
+        if (length < 0) {
+            return false;
+        }
+        if (length > 0) {
+            m_inUsed += length;
+            m_pending.pop_front();
+            //drop the decoded prefix once it dominates the buffer
+            if (m_inUsed > m_in.size() / 2) {
+                m_in.erase(0, m_inUsed);
+                m_inUsed = 0;
+            }
+            return true;
+        }
+        ssize_t received = read(m_fd, buffer, sizeof(buffer));
+        if (received == 0 || (received < 0 && errno != EINTR)) {
+            return false;
+        }
+        if (received > 0) {
+            m_in.append(buffer, received);
+        }
+    }
+}
+
+bool VacDBClient::roundTrip(op_t op, const Patient &patient, int newSerial, Response &response) {
+    return send(op, vector<Patient>(1, patient), newSerial) != 0 && receive(response) && response.statuses.size() == 1;
+}
+
+bool VacDBClient::insert(const Patient &patient) {
+    Response response;
+    return roundTrip(OP_INSERT, patient, 0, response) && response.statuses[0];
+}
+
+bool VacDBClient::remove(const Patient &patient) {
+    Response response;
+    return roundTrip(OP_REMOVE, patient, 0, response) && response.statuses[0];
+}
+
+const Patient VacDBClient::getPatient(string name, int serial) {
+    Response response;
+    if (roundTrip(OP_GET, Patient(name, serial, true), 0, response) && response.patients.size() == 1) {
+        return response.patients[0];
+    }
+    return Patient();
+}
+
+bool VacDBClient::updateSerialNumber(const Patient &patient, int serial) {
+    Response response;
+    return roundTrip(OP_UPDATE, patient, serial, response) && response.statuses[0];
+}
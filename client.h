@@ -0,0 +1,41 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef CLIENT_H
+#define CLIENT_H
+#include <deque>
+#include <string>
+#include <vector>
+#include "vacdb.h"
+#include "protocol.h"
+using namespace std;
+// Blocking client of VacDBServer. send() only queues a request, so any number
+// of requests can be pipelined before receive() collects the responses in order.
+class VacDBClient{
+public:
+    VacDBClient();
+    ~VacDBClient();
+    bool connectUnix(const string& path);
+    bool connectTcp(int port);
+    // queues a request; the id is assigned by the client and returned, 0 if
+    // the request cannot be encoded (see encodeRequest)
+    uint32_t send(op_t op, const vector<Patient>& patients, int newSerial = 0);
+    // sends everything queued
+    bool flush();
+    // flushes and waits for the response of the oldest outstanding request
+    bool receive(Response& response);
+    int outstanding() const {return int(m_pending.size());}
+
+    // one round trip each
+    bool insert(const Patient& patient);
+    bool remove(const Patient& patient);
+    const Patient getPatient(string name, int serial);
+    bool updateSerialNumber(const Patient& patient, int serial);
+private:
+    bool roundTrip(op_t op, const Patient& patient, int newSerial, Response& response);
+    int m_fd;
+    uint32_t m_nextId;
+    string m_out;               // requests not yet sent
+    string m_in;                // received bytes not yet decoded
+    size_t m_inUsed;            // decoded prefix of m_in
+    deque<op_t> m_pending;      // operations of the outstanding requests, oldest first
+};
+#endif
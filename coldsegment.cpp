@@ -0,0 +1,217 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "coldsegment.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char COLDMAGIC[8] = {'V', 'A', 'C', 'D', 'B', 'C', 'S', '1'};
+static const size_t COLDHEADER = sizeof(COLDMAGIC) + 2 * sizeof(uint32_t);
+static const int COLDFILTERBITS = 10;
+
+ColdSegment *ColdSegment::write(const string &path, vector<ColdEntry> &entries) {
+    sort(entries.begin(), entries.end(), [](const ColdEntry &lhs, const ColdEntry &rhs) {
+        if (lhs.hash != rhs.hash) return lhs.hash < rhs.hash;
+        if (lhs.serial != rhs.serial) return lhs.serial < rhs.serial;
+        return lhs.name < rhs.name;
+    });
+    uint64_t poolBytes = 0;
+    for (ColdEntry &entry: entries) {
+        poolBytes += entry.name.size();
+    }
+    if (entries.size() > UINT32_MAX || poolBytes > UINT32_MAX) {
+        return nullptr;
+    }
+
+    //the file is replaced in one rename, a mapping of the previous one stays valid
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        uint32_t counts[2] = {uint32_t(entries.size()), uint32_t(poolBytes)};
+        out.write(COLDMAGIC, sizeof(COLDMAGIC));
+        out.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+        uint32_t offset = 0;
+        for (ColdEntry &entry: entries) {
+            Record record = {entry.hash, entry.serial, offset, uint32_t(entry.name.size())};
+            out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+            offset += record.m_nameLength;
+        }
+        for (ColdEntry &entry: entries) {
+            out.write(entry.name.data(), streamsize(entry.name.size()));
+        }
+        if (!out.flush()) {
+            unlink(tempPath.c_str());
+            return nullptr;
+        }
+    }
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return nullptr;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    size_t bytes = COLDHEADER + entries.size() * sizeof(Record) + poolBytes;
+    void *map = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+    //lookups binary search the records, read-ahead would only waste page cache
+    madvise(map, bytes, MADV_RANDOM);
+
+    ColdSegment *segment = new ColdSegment();
+    segment->m_map = map;
+    segment->m_bytes = bytes;
+    segment->m_count = uint32_t(entries.size());
+    segment->m_records = reinterpret_cast<const Record *>(static_cast<const char *>(map) + COLDHEADER);
+    segment->m_names = reinterpret_cast<const char *>(segment->m_records + entries.size());
+    segment->m_deleted.assign(entries.size(), 0);
+    segment->m_filter.reset(new BloomFilter(max(int(entries.size()), 1), COLDFILTERBITS));
+    for (ColdEntry &entry: entries) {
+        segment->m_filter->add(entry.name, entry.serial);
+    }
+    return segment;
+}
+
+ColdSegment::~ColdSegment() {
+    if (m_map != nullptr) {
+        munmap(m_map, m_bytes);
+    }
+}
+
+long ColdSegment::find(unsigned int hash, const string &name, int serial) const {
+    if (!m_filter->mayContain(name, serial)) {
+        return -1;
+    }
+    //first record with the hash, then the few sharing it
+    const Record *end = m_records + m_count;
+    const Record *record = lower_bound(m_records, end, hash,
+                                       [](const Record &lhs, unsigned int rhs) { return lhs.m_hash < rhs; });
+    for (; record != end && record->m_hash == hash; record++) {
+        if (record->m_serial == serial && record->m_nameLength == name.size() &&
+            memcmp(m_names + record->m_nameOffset, name.data(), name.size()) == 0) {
+            long index = record - m_records;
+            return __atomic_load_n(&m_deleted[index], __ATOMIC_RELAXED) ? -1 : index;
+        }
+    }
+    return -1;
+}
+
+void ColdSegment::remove(long record) {
+    if (record >= 0 && record < long(m_count) && !m_deleted[record]) {
+        __atomic_store_n(&m_deleted[record], uint8_t(1), __ATOMIC_RELAXED);
+        m_numDeleted++;
+    }
+}
+
+void ColdSegment::liveEntries(vector<ColdEntry> &entries) const {
+    for (uint32_t i = 0; i < m_count; i++) {
+        if (!m_deleted[i]) {
+            const Record &record = m_records[i];
+            entries.push_back({record.m_hash, record.m_serial, string(m_names + record.m_nameOffset, record.m_nameLength)});
+        }
+    }
+}
+
+ColdTier *ColdTier::push(const ColdTier *previous, const string &basePath, vector<ColdEntry> &entries) {
+    unique_ptr<ColdTier> tier(new ColdTier());
+    if (previous != nullptr) {
+        tier->m_runs = previous->m_runs;
+        tier->m_nextRun = previous->m_nextRun;
+        tier->m_mergedRecords = previous->m_mergedRecords;
+    }
+    Run run{nullptr, basePath + "." + to_string(tier->m_nextRun++)};
+    run.m_segment.reset(ColdSegment::write(run.m_path, entries));
+    if (run.m_segment == nullptr) {
+        return nullptr;
+    }
+    tier->m_runs.insert(tier->m_runs.begin(), run);
+
+    //a failed merge only leaves one run more to search
+    vector<Run> &runs = tier->m_runs;
+    while (runs.size() > 1 && 2 * runs[0].m_segment->numLive() >= runs[1].m_segment->numLive()) {
+        vector<ColdEntry> combined;
+        combined.reserve(runs[0].m_segment->numLive() + runs[1].m_segment->numLive());
+        runs[0].m_segment->liveEntries(combined);
+        runs[1].m_segment->liveEntries(combined);
+        Run merged{nullptr, basePath + "." + to_string(tier->m_nextRun++)};
+        merged.m_segment.reset(ColdSegment::write(merged.m_path, combined));
+        if (merged.m_segment == nullptr) {
+            break;
+        }
+        tier->m_mergedRecords += merged.m_segment->numRecords();
+        unlink(runs[0].m_path.c_str());
+        unlink(runs[1].m_path.c_str());
+        runs.erase(runs.begin(), runs.begin() + 2);
+        runs.insert(runs.begin(), merged);
+    }
+    return tier.release();
+}
+
+void ColdTier::unlinkFiles() const {
+    for (const Run &run: m_runs) {
+        unlink(run.m_path.c_str());
+    }
+}
+
+long ColdTier::find(unsigned int hash, const string &name, int serial) const {
+    long first = 0;
+    for (const Run &run: m_runs) {
+        long record = run.m_segment->find(hash, name, serial);
+        if (record >= 0) {
+            return first + record;
+        }
+        first += run.m_segment->numRecords();
+    }
+    return -1;
+}
+
+void ColdTier::remove(long record) {
+    for (const Run &run: m_runs) {
+        if (record < 0) {
+            return;
+        }
+        if (record < run.m_segment->numRecords()) {
+            run.m_segment->remove(record);
+            return;
+        }
+        record -= run.m_segment->numRecords();
+    }
+}
+
+long ColdTier::numLive() const {
+    long live = 0;
+    for (const Run &run: m_runs) {
+        live += run.m_segment->numLive();
+    }
+    return live;
+}
+
+size_t ColdTier::fileBytes() const {
+    size_t bytes = 0;
+    for (const Run &run: m_runs) {
+        bytes += run.m_segment->fileBytes();
+    }
+    return bytes;
+}
+
+size_t ColdTier::memoryBytes() const {
+    size_t bytes = 0;
+    for (const Run &run: m_runs) {
+        bytes += run.m_segment->memoryBytes();
+    }
+    return bytes;
+}
+
+void ColdTier::liveEntries(vector<ColdEntry> &entries) const {
+    for (const Run &run: m_runs) {
+        run.m_segment->liveEntries(entries);
+    }
+}
@@ -0,0 +1,92 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef COLDSEGMENT_H
+#define COLDSEGMENT_H
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bloomfilter.h"
+using namespace std;
+// a patient handed to ColdSegment::write()
+struct ColdEntry{
+    unsigned int hash;
+    int serial;
+    string name;
+};
+// The cold tier of VacDB: an immutable file of patients sorted by (hash, serial, name),
+// mapped read-only and searched in place, with a Bloom filter in memory in front of it.
+// File layout: "VACDBCS1", uint32 record count, uint32 name pool bytes, the records
+// {uint32 hash, int32 serial, uint32 name offset, uint32 name length}, then the names.
+// Removing a patient only sets a deleted flag in memory; the next segment written
+// leaves it out. remove() is for a single writer and may run concurrently with find().
+class ColdSegment{
+public:
+    // writes entries (in any order) to path via a temporary file and maps the result, nullptr on failure
+    static ColdSegment* write(const string& path, vector<ColdEntry>& entries);
+    ~ColdSegment();
+    ColdSegment(const ColdSegment&) = delete;
+    ColdSegment& operator=(const ColdSegment&) = delete;
+    // index of the live record for name and serial, -1 if there is none
+    long find(unsigned int hash, const string& name, int serial) const;
+    void remove(long record);
+    long numLive() const {return long(m_count) - m_numDeleted;}
+    size_t fileBytes() const {return m_bytes;}
+    // memory the segment needs besides the mapped file
+    size_t memoryBytes() const {return m_filter->memoryBytes() + m_deleted.size();}
+    // appends the live records, used to carry them over into the next segment
+    void liveEntries(vector<ColdEntry>& entries) const;
+    long numRecords() const {return long(m_count);}
+private:
+    struct Record{
+        uint32_t m_hash;
+        int32_t  m_serial;
+        uint32_t m_nameOffset;
+        uint32_t m_nameLength;
+    };
+    ColdSegment() = default;
+    const Record* m_records = nullptr;
+    const char*   m_names = nullptr;
+    void*         m_map = nullptr;
+    size_t        m_bytes = 0;
+    uint32_t      m_count = 0;
+    long          m_numDeleted = 0;
+    vector<uint8_t> m_deleted;     // per record, set by remove()
+    unique_ptr<BloomFilter> m_filter;
+};
+// The cold tier as a stack of segments ("runs"), newest first. A demotion writes only the
+// demoted patients as a new run instead of rewriting the whole tier; whenever the newest run
+// holds at least half as many live patients as the one below, the two are merged into one.
+// The runs thus shrink geometrically from the oldest, a lookup checks O(log n) Bloom filters
+// and every cold patient is rewritten O(log n) times in all, where rewriting the tier on each
+// demotion cost O(n) per demotion. Merges run synchronously within the demotion that
+// triggers them. A tier is immutable apart from the deleted flags of its runs, which it
+// shares with the tier it was pushed onto; records are numbered across the runs.
+class ColdTier{
+public:
+    // the runs of previous (nullptr for none) under a new run of entries written to
+    // basePath.<number>; the files of merged runs are removed, mappings of them stay valid
+    // nullptr on failure, previous and its files are unchanged then
+    static ColdTier* push(const ColdTier* previous, const string& basePath, vector<ColdEntry>& entries);
+    // removes the files of the runs, the mappings stay valid
+    void unlinkFiles() const;
+    // index of the live record for name and serial, -1 if there is none
+    long find(unsigned int hash, const string& name, int serial) const;
+    void remove(long record);
+    long numLive() const;
+    size_t fileBytes() const;
+    size_t memoryBytes() const;
+    void liveEntries(vector<ColdEntry>& entries) const;
+    int numRuns() const {return int(m_runs.size());}
+    // records written by merges since the first run, the write cost beyond the demotions themselves
+    long mergedRecords() const {return m_mergedRecords;}
+private:
+    struct Run{
+        shared_ptr<ColdSegment> m_segment;
+        string m_path;
+    };
+    ColdTier() = default;
+    vector<Run> m_runs;          // newest first
+    long m_nextRun = 0;          // number of the next run file
+    long m_mergedRecords = 0;
+};
+#endif
@@ -0,0 +1,300 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "combiner.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+static atomic<long> nextCombinerId(1);
+
+// a slot the calling thread holds in a combiner
+struct HeldSlot{
+    long m_combiner;
+    weak_ptr<void> m_slots;              // keeps nothing alive, tells whether the combiner still exists
+    atomic<bool>* m_taken;
+    int m_slot;
+};
+
+// the slots of the combiners a thread has used, given back when the thread exits
+struct ThreadSlots{
+    vector<HeldSlot> m_held;
+    ~ThreadSlots() {
+        for (HeldSlot &held: m_held) {
+            shared_ptr<void> slots = held.m_slots.lock();
+            if (slots != nullptr) {
+                held.m_taken->store(false, memory_order_release);
+            }
+        }
+    }
+};
+static thread_local ThreadSlots threadSlots;
+
+// clears a flag when the scope is left, also by an exception
+struct FlagReset{
+    atomic<bool> &m_flag;
+    ~FlagReset() {
+        m_flag.store(false);
+    }
+};
+
+VacDBCombiner::VacDBCombiner(VacDB &vacdb, int maxThreads)
+    : m_vacdb(vacdb), m_id(nextCombinerId++), m_maxThreads(max(1, maxThreads)),
+      m_slots(new Slot[max(1, maxThreads)]), m_numSlots(0), m_combining(false) {
+    m_batch.reserve(m_maxThreads);
+}
+
+VacDBCombiner::~VacDBCombiner() {
+    //a request is only left pending while some thread is combining or about to
+    while (m_combining.load() || anyPending()) {
+        tryCombine();
+        this_thread::yield();
+    }
+}
+
+int VacDBCombiner::threadSlot() {
+    vector<HeldSlot> &held = threadSlots.m_held;
+    for (HeldSlot &slot: held) {
+        if (slot.m_combiner == m_id) {
+            return slot.m_slot;
+        }
+    }
+    //a slot given back by an exited thread is reused; its last request may still be answered,
+    //which post() waits for
+    for (int i = 0; i < m_maxThreads; i++) {
+        bool expected = false;
+        if (!m_slots[i].m_taken.load(memory_order_relaxed) && m_slots[i].m_taken.compare_exchange_strong(expected, true)) {
+            int numSlots = m_numSlots.load();
+            while (numSlots <= i && !m_numSlots.compare_exchange_weak(numSlots, i + 1)) {
+            }
+            held.erase(remove_if(held.begin(), held.end(), [](const HeldSlot &slot) { return slot.m_slots.expired(); }),
+                       held.end());
+            held.push_back(HeldSlot{m_id, m_slots, &m_slots[i].m_taken, i});
+            return i;
+        }
+    }
+    return -1;
+}
+
+void VacDBCombiner::post(int slot, const CombinerRequest &request, promise<CombinerResult> *answer) {
+    Slot &mine = m_slots[slot];
+    //the previous request of this thread may still be waiting for a combiner
+    while (mine.m_state.load(memory_order_acquire) != SLOTEMPTY) {
+        tryCombine();
+        this_thread::yield();
+    }
+    mine.m_request = request;
+    mine.m_promise = answer;
+    mine.m_state.store(SLOTPENDING);
+}
+
+CombinerResult VacDBCombiner::execute(const CombinerRequest &request) {
+    int slot = threadSlot();
+    if (slot < 0) {
+        //without a slot the thread takes the table for itself
+        while (m_combining.exchange(true)) {
+            this_thread::yield();
+        }
+        CombinerResult result;
+        {
+            FlagReset release{m_combining};
+            result = run(request);
+            m_stats.direct++;
+        }
+        tryCombine();
+        return result;
+    }
+
+    post(slot, request, nullptr);
+    Slot &mine = m_slots[slot];
+    for (int spins = 0; mine.m_state.load(memory_order_acquire) != SLOTDONE; spins++) {
+        tryCombine();
+        //a waiting thread gives its core to the combiner after a short spin
+        if (spins >= 64) {
+            this_thread::yield();
+        }
+    }
+    CombinerResult result = mine.m_result;
+    exception_ptr error = mine.m_error;
+    mine.m_error = nullptr;
+    mine.m_state.store(SLOTEMPTY, memory_order_release);
+    if (error != nullptr) {
+        rethrow_exception(error);
+    }
+    return result;
+}
+
+future<CombinerResult> VacDBCombiner::submit(const CombinerRequest &request) {
+    int slot = threadSlot();
+    if (slot < 0) {
+        promise<CombinerResult> answer;
+        answer.set_value(execute(request));
+        return answer.get_future();
+    }
+    promise<CombinerResult> *answer = new promise<CombinerResult>();
+    future<CombinerResult> result = answer->get_future();
+    post(slot, request, answer);
+    tryCombine();
+    return result;
+}
+
+bool VacDBCombiner::insert(const Patient &patient) {
+    return execute({COMBINEINSERT, patient}).success;
+}
+
+bool VacDBCombiner::remove(const Patient &patient) {
+    return execute({COMBINEREMOVE, patient}).success;
+}
+
+Patient VacDBCombiner::getPatient(const string &name, int serial) {
+    return execute({COMBINEGET, Patient(name, serial)}).patient;
+}
+
+bool VacDBCombiner::updateSerialNumber(const Patient &patient, int serial) {
+    return execute({COMBINEUPDATE, patient, serial}).success;
+}
+
+bool VacDBCombiner::anyPending() const {
+    int numSlots = min(m_numSlots.load(), m_maxThreads);
+    for (int i = 0; i < numSlots; i++) {
+        if (m_slots[i].m_state.load() == SLOTPENDING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void VacDBCombiner::tryCombine() {
+    //a thread that posts while the combiner is finishing either takes the flag itself or its
+    //request is seen by the check after the combiner lets go (all of this is sequentially consistent)
+    while (anyPending() && !m_combining.exchange(true)) {
+        FlagReset release{m_combining};
+        runBatch();
+    }
+}
+
+void VacDBCombiner::runBatch() {
+    m_batch.clear();
+    int numSlots = min(m_numSlots.load(), m_maxThreads);
+    for (int i = 0; i < numSlots; i++) {
+        if (m_slots[i].m_state.load(memory_order_acquire) == SLOTPENDING) {
+            m_batch.push_back(i);
+        }
+    }
+    if (m_batch.empty()) {
+        return;
+    }
+
+    //operations on the same patient become neighbours, in slot order among themselves
+    auto key = [this](int slot) -> const Patient & { return m_slots[slot].m_request.patient; };
+    stable_sort(m_batch.begin(), m_batch.end(), [&](int lhs, int rhs) {
+        const Patient &left = key(lhs), &right = key(rhs);
+        return left.m_serial != right.m_serial ? left.m_serial < right.m_serial : left.m_name < right.m_name;
+    });
+
+    //whether the patient of the previous operation is known to be present (1) or absent (0), -1 if unknown
+    int known = -1;
+    //an exception from the table must not leave it in batch mode; the transfer steps deferred
+    //so far are then run by later inserts and removes
+    struct BatchReset{
+        VacDB &m_vacdb;
+        ~BatchReset() {
+            m_vacdb.m_batching = false;
+            m_vacdb.m_batchedTransfers = 0;
+        }
+    } batchReset{m_vacdb};
+    m_vacdb.beginBatch();
+    for (size_t b = 0; b < m_batch.size(); b++) {
+        Slot &slot = m_slots[m_batch[b]];
+        const CombinerRequest &request = slot.m_request;
+        if (b > 0 && (request.patient.m_serial != key(m_batch[b - 1]).m_serial ||
+                      request.patient.m_name != key(m_batch[b - 1]).m_name)) {
+            known = -1;
+        }
+
+        //answers that follow from the previous operation on the same patient
+        CombinerResult result;
+        bool coalesced = true;
+        if (request.op == COMBINEGET && known != -1) {
+            result.success = known == 1;
+            if (result.success) {
+                result.patient = Patient(request.patient.m_name, request.patient.m_serial, true);
+            }
+        } else if (request.op == COMBINEINSERT && known == 1) {
+            result.success = false;
+        } else if (request.op == COMBINEREMOVE && known == 0) {
+            result.success = false;
+        } else {
+            coalesced = false;
+            //the rest of the batch goes on, the exception is for the thread of this request only
+            try {
+                result = run(request);
+            } catch (...) {
+                slot.m_error = current_exception();
+            }
+        }
+        m_stats.coalesced += coalesced;
+
+        switch (request.op) {
+            case COMBINEGET:
+                known = result.success;
+                break;
+            case COMBINEINSERT:
+                //a failed insert may have been refused for another reason than a duplicate
+                known = result.success ? 1 : known;
+                break;
+            case COMBINEREMOVE:
+                known = 0;
+                break;
+            case COMBINEUPDATE:
+                //a failed update changed nothing
+                known = result.success ? -1 : known;
+                break;
+        }
+        //nothing is known after an operation that threw part way
+        if (slot.m_error != nullptr) {
+            known = -1;
+        }
+        slot.m_result = result;
+    }
+    m_stats.deferredTransfers += m_vacdb.endBatch();
+    m_stats.batches++;
+    m_stats.operations += m_batch.size();
+
+    //answers go out only once the deferred transfer steps are done
+    for (int index: m_batch) {
+        Slot &slot = m_slots[index];
+        if (slot.m_promise != nullptr) {
+            promise<CombinerResult> *answer = slot.m_promise;
+            slot.m_promise = nullptr;
+            if (slot.m_error != nullptr) {
+                answer->set_exception(slot.m_error);
+                slot.m_error = nullptr;
+            } else {
+                answer->set_value(slot.m_result);
+            }
+            delete answer;
+            slot.m_state.store(SLOTEMPTY, memory_order_release);
+        } else {
+            slot.m_state.store(SLOTDONE, memory_order_release);
+        }
+    }
+}
+
+CombinerResult VacDBCombiner::run(const CombinerRequest &request) {
+    CombinerResult result;
+    switch (request.op) {
+        case COMBINEINSERT:
+            result.success = m_vacdb.insert(request.patient);
+            break;
+        case COMBINEREMOVE:
+            result.success = m_vacdb.remove(request.patient);
+            break;
+        case COMBINEGET:
+            result.patient = m_vacdb.getPatient(request.patient.m_name, request.patient.m_serial);
+            result.success = !result.patient.m_name.empty();
+            break;
+        case COMBINEUPDATE:
+            result.success = m_vacdb.updateSerialNumber(request.patient, request.newSerial);
+            break;
+    }
+    return result;
+}
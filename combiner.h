@@ -0,0 +1,88 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef COMBINER_H
+#define COMBINER_H
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include "vacdb.h"
+using namespace std;
+enum combine_op_t {COMBINEINSERT, COMBINEREMOVE, COMBINEGET, COMBINEUPDATE};
+struct CombinerRequest{
+    combine_op_t op = COMBINEGET;
+    Patient patient;
+    int newSerial = 0;              // only used by COMBINEUPDATE
+};
+struct CombinerResult{
+    bool success = false;           // for COMBINEGET: the patient was found
+    Patient patient;                // found patient of COMBINEGET (empty if not found)
+};
+struct CombinerStats{
+    long batches = 0;
+    long operations = 0;            // executed in batches (operations / batches is the mean batch size)
+    long coalesced = 0;             // answered from an earlier operation on the same patient in the batch
+    long deferredTransfers = 0;     // rehash transfer steps run together at the end of a batch
+    long direct = 0;                // run by threads beyond maxThreads, without a slot
+};
+// Flat-combining front-end of a VacDB for many producer threads. Every thread
+// posts its operation into its own slot; whichever thread finds the table free
+// becomes the combiner and executes all posted operations as one batch while
+// the others wait for their slot to be answered. Within a batch, operations on
+// the same patient are executed next to each other, so that a repeated lookup
+// or a duplicate insert is answered without probing, and the transfer steps of
+// an incremental rehash are run together after the batch instead of after every
+// insert and remove. Operations of different threads posted at the same time
+// take effect in an unspecified order; those of one thread in program order.
+// An exception thrown by the table is passed to the thread whose operation
+// raised it. The VacDB must only be used through the combiner while it exists.
+class Tester;
+class VacDBCombiner{
+public:
+    friend class Tester;
+    // threads beyond maxThreads using the combiner at the same time get no slot and lock the table directly
+    explicit VacDBCombiner(VacDB& vacdb, int maxThreads = 64);
+    ~VacDBCombiner();
+    VacDBCombiner(const VacDBCombiner&) = delete;
+    VacDBCombiner& operator=(const VacDBCombiner&) = delete;
+    // posts the request and waits for its result, combining if no other thread is
+    CombinerResult execute(const CombinerRequest& request);
+    // posts the request and returns at once; a thread has at most one request in flight,
+    // so submit waits for the previous request of the calling thread to be answered first
+    future<CombinerResult> submit(const CombinerRequest& request);
+    bool insert(const Patient& patient);
+    bool remove(const Patient& patient);
+    Patient getPatient(const string& name, int serial);
+    bool updateSerialNumber(const Patient& patient, int serial);
+    // only consistent while no operation is running
+    CombinerStats getStats() const {return m_stats;}
+private:
+    enum slot_t {SLOTEMPTY, SLOTPENDING, SLOTDONE};
+    struct alignas(64) Slot{
+        atomic<bool>     m_taken{false};        // held by a thread, given back when the thread exits
+        atomic<int>      m_state{SLOTEMPTY};
+        CombinerRequest  m_request;
+        CombinerResult   m_result;
+        exception_ptr    m_error;               // thrown by the table for this request, rethrown to its thread
+        promise<CombinerResult>* m_promise = nullptr; // set by submit(), answered and freed by the combiner
+    };
+    // slot of the calling thread, -1 if all slots are taken (it is tried again on the next call)
+    int threadSlot();
+    // posts request in slot, waiting until the slot is free
+    void post(int slot, const CombinerRequest& request, promise<CombinerResult>* answer);
+    // combines as long as the table is free and requests are pending
+    void tryCombine();
+    bool anyPending() const;
+    void runBatch();
+    CombinerResult run(const CombinerRequest& request);
+
+    VacDB&             m_vacdb;
+    long               m_id;            // tells combiners apart in the per-thread slot registry
+    int                m_maxThreads;
+    shared_ptr<Slot[]> m_slots;         // shared with the exiting threads that give their slots back
+    atomic<int>        m_numSlots;      // one past the highest slot handed out so far
+    atomic<bool>       m_combining;     // held by the thread executing operations
+    CombinerStats      m_stats;
+    vector<int>        m_batch;         // slots of the batch being run, reused
+};
+#endif
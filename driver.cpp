@@ -5,6 +5,10 @@
 #include <vector>
 #include <algorithm>
 #include <ctime>     //used to get the current time
+#include <chrono>
+#include <iomanip>
+#include <cstdlib>
+#include "client.h"
 // We can use the Random class to generate the test data randomly!
 enum RANDOM {UNIFORMINT, UNIFORMREAL, NORMAL, SHUFFLE};
 class Random {
@@ -99,9 +103,10 @@ public:
         // the parameter size specifies the length of string we ask for
         // to use ASCII char the number range in constructor must be set to 97 - 122
         // and the Random type must be UNIFORMINT (it is default in constructor)
-        string output = "";
+        string output;
+        output.reserve(size);
         for (int i=0;i<size;i++){
-            output = output + (char)getRandNum();
+            output += (char)getRandNum();
         }
         return output;
     }
@@ -125,7 +130,12 @@ unsigned int hashCode(const string str);
 
 string namesDB[6] = {"john", "serina", "mike", "celina", "alexander", "jessica"};
 
-int main(){
+int runLoadClient(int argc, char **argv);
+
+int main(int argc, char **argv){
+    // Driver --server unix:<path>|tcp:<port> ... turns the driver into a load generator
+    if (argc > 2 && string(argv[1]) == "--server")
+        return runLoadClient(argc, argv);
 
     vector<Patient> dataList;
     Random RndID(MINID,MAXID);
@@ -162,4 +172,79 @@ unsigned int hashCode(const string str) {
     for (unsigned int i = 0 ; i < str.length(); i++)
         val = val * thirtyThree + str[i] ;
     return val ;
-}
\ No newline at end of file
+}
+
+// value below which the given fraction of the samples lie
+double percentile(vector<double> samples, double fraction){
+    if (samples.empty()) return 0;
+    size_t rank = min(samples.size() - 1, size_t(fraction * samples.size()));
+    nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+// sends one request per batch of patients keeping up to depth requests in flight,
+// prints throughput and latency percentiles of the phase
+bool runPhase(VacDBClient & client, const char * name, op_t op, const vector<Patient> & patients, int batch, int depth){
+    vector<double> latencies;
+    vector<chrono::steady_clock::time_point> sentAt;
+    size_t next = 0;
+    long succeeded = 0;
+    auto start = chrono::steady_clock::now();
+    while (next < patients.size() || client.outstanding() > 0){
+        // top up the pipeline, then wait for the oldest response
+        while (next < patients.size() && client.outstanding() < depth){
+            size_t last = min(patients.size(), next + batch);
+            if (client.send(op, vector<Patient>(patients.begin() + next, patients.begin() + last)) == 0) return false;
+            sentAt.push_back(chrono::steady_clock::now());
+            next = last;
+        }
+        Response response;
+        if (!client.receive(response)) return false;
+        latencies.push_back(chrono::duration<double>(chrono::steady_clock::now() - sentAt[latencies.size()]).count() * 1e6);
+        for (uint8_t status : response.statuses) succeeded += status;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << setw(8) << name << fixed << setprecision(0) << setw(12) << latencies.size() / seconds
+         << setw(12) << patients.size() / seconds << setprecision(1)
+         << setw(10) << percentile(latencies, 0.5) << setw(10) << percentile(latencies, 0.99)
+         << setw(10) << percentile(latencies, 0.999) << setw(10) << succeeded << endl;
+    return true;
+}
+
+int runLoadClient(int argc, char **argv){
+    string server = argv[2];
+    int numPatients = 20000; // the table tops out at MAXPRIME slots
+    int depth = 32;
+    int batch = 1;
+    for (int i = 3; i + 1 < argc; i += 2){
+        string option = argv[i];
+        if (option == "--patients") numPatients = atoi(argv[i + 1]);
+        else if (option == "--pipeline") depth = max(1, atoi(argv[i + 1]));
+        else if (option == "--batch") batch = max(1, atoi(argv[i + 1]));
+    }
+
+    VacDBClient client;
+    bool connected = server.compare(0, 5, "unix:") == 0 ? client.connectUnix(server.substr(5))
+                   : server.compare(0, 4, "tcp:") == 0 ? client.connectTcp(atoi(server.substr(4).c_str()))
+                   : false;
+    if (!connected){
+        cout << "cannot connect to " << server << endl;
+        return 1;
+    }
+
+    // distinct random patients, names of 10 lowercase letters
+    Random RndLetter(97, 122);
+    Random RndID(MINID, MAXID);
+    vector<Patient> patients;
+    for (int i = 0; i < numPatients; i++)
+        patients.push_back(Patient(RndLetter.getRandString(10), RndID.getRandNum(), true));
+
+    bool single = batch == 1;
+    cout << numPatients << " patients, pipeline depth " << depth << ", batch " << batch << endl;
+    cout << setw(8) << "phase" << setw(12) << "requests/s" << setw(12) << "ops/s" << setw(10) << "p50 us"
+         << setw(10) << "p99 us" << setw(10) << "p99.9 us" << setw(10) << "success" << endl;
+    bool ok = runPhase(client, "insert", single ? OP_INSERT : OP_BATCHINSERT, patients, batch, depth) &&
+              runPhase(client, "get", single ? OP_GET : OP_BATCHGET, patients, batch, depth) &&
+              runPhase(client, "remove", single ? OP_REMOVE : OP_BATCHREMOVE, patients, batch, depth);
+    return ok ? 0 : 1;
+}
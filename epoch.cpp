@@ -0,0 +1,123 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "epoch.h"
+#include <algorithm>
+#include <stdexcept>
+
+static atomic<long> nextManagerId(1);
+
+// reader slots the calling thread holds, given back when the thread exits
+struct HeldSlot{
+    long m_manager;
+    weak_ptr<void> m_readers;            // keeps nothing alive, tells whether the slots still exist
+    atomic<bool>* m_taken;
+    void* m_slot;
+};
+struct ThreadSlots{
+    vector<HeldSlot> m_held;
+    ~ThreadSlots() {
+        for (HeldSlot &held: m_held) {
+            shared_ptr<void> readers = held.m_readers.lock();
+            if (readers != nullptr) {
+                held.m_taken->store(false, memory_order_release);
+            }
+        }
+    }
+};
+static thread_local ThreadSlots threadSlots;
+
+EpochManager::EpochManager() : m_id(nextManagerId++), m_epoch(1), m_readers(new ReaderSlot[MAXREADERS]),
+                               m_sinceReclaim(0) {
+    for (int i = 0; i < MAXREADERS; i++) {
+        m_readers[i].m_taken.store(false);
+        m_readers[i].m_epoch.store(INACTIVE);
+    }
+}
+
+EpochManager::~EpochManager() {
+    //no reader may be running once the manager is destroyed
+    for (Retired &retired: m_retired) {
+        retired.m_deleter(retired.m_ptr, retired.m_size);
+    }
+}
+
+EpochManager::ReaderSlot *EpochManager::readerSlot() {
+    //a thread keeps the slot it claimed the first time, cached for the last manager it used
+    thread_local long cachedManager = 0;
+    thread_local ReaderSlot *cachedSlot = nullptr;
+    if (cachedManager == m_id) {
+        return cachedSlot;
+    }
+
+    ReaderSlot *freeSlot = nullptr;
+    vector<HeldSlot> &held = threadSlots.m_held;
+    for (size_t i = 0; i < held.size() && freeSlot == nullptr; i++) {
+        if (held[i].m_manager == m_id) {
+            freeSlot = static_cast<ReaderSlot *>(held[i].m_slot);
+        }
+    }
+    if (freeSlot == nullptr) {
+        //slots of destroyed managers are forgotten
+        held.erase(remove_if(held.begin(), held.end(), [](const HeldSlot &slot) { return slot.m_readers.expired(); }),
+                   held.end());
+        for (int i = 0; freeSlot == nullptr && i < MAXREADERS; i++) {
+            bool expected = false;
+            if (m_readers[i].m_taken.compare_exchange_strong(expected, true)) {
+                freeSlot = &m_readers[i];
+            }
+        }
+        if (freeSlot == nullptr) {
+            throw runtime_error("EpochManager: too many reader threads");
+        }
+        held.push_back(HeldSlot{m_id, m_readers, &freeSlot->m_taken, freeSlot});
+    }
+
+    cachedManager = m_id;
+    cachedSlot = freeSlot;
+    return freeSlot;
+}
+
+void EpochManager::enter() {
+    //the announcement must be visible before the reader loads any shared pointer,
+    //pairs with the fence in reclaim()
+    readerSlot()->m_epoch.store(m_epoch.load(memory_order_acquire), memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void EpochManager::exit() {
+    readerSlot()->m_epoch.store(INACTIVE, memory_order_release);
+}
+
+void EpochManager::retire(void *ptr, deleter_fn deleter, size_t size) {
+    //readers that enter from now on announce a later epoch and cannot reach ptr
+    unsigned long epoch = m_epoch.fetch_add(1, memory_order_acq_rel);
+    m_retired.push_back(Retired{ptr, deleter, size, epoch});
+
+    if (++m_sinceReclaim >= RECLAIMBATCH) {
+        reclaim();
+    }
+}
+
+void EpochManager::reclaim() {
+    m_sinceReclaim = 0;
+    atomic_thread_fence(memory_order_seq_cst);
+
+    //the oldest epoch any active reader may still be working in
+    unsigned long oldest = m_epoch.load(memory_order_acquire);
+    for (int i = 0; i < MAXREADERS; i++) {
+        unsigned long epoch = m_readers[i].m_epoch.load(memory_order_acquire);
+        if (epoch != INACTIVE && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    //memory retired in an epoch before the oldest active one is unreachable
+    size_t kept = 0;
+    for (size_t i = 0; i < m_retired.size(); i++) {
+        if (m_retired[i].m_epoch < oldest) {
+            m_retired[i].m_deleter(m_retired[i].m_ptr, m_retired[i].m_size);
+        } else {
+            m_retired[kept++] = m_retired[i];
+        }
+    }
+    m_retired.resize(kept);
+}
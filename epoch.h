@@ -0,0 +1,68 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef EPOCH_H
+#define EPOCH_H
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+using namespace std;
+// Epoch-based reclamation for one writer and many lock-free readers.
+// Readers announce the epoch they entered in; memory the writer unlinks is
+// retired with the current epoch and freed once no reader is still inside an
+// epoch that could have seen it.
+class EpochManager{
+public:
+    // deleter receives the retired pointer and the size passed to retire()
+    typedef void (*deleter_fn)(void*, size_t);
+
+    EpochManager();
+    ~EpochManager();
+    // readers bracket every access to shared memory with enter() and exit()
+    // a thread must not nest critical sections of the same manager
+    // a thread holds a reader slot from its first enter() until it exits, at most MAXREADERS
+    // threads may hold one at a time
+    void enter();
+    void exit();
+    // called by the writer after ptr has been unlinked from every shared structure
+    void retire(void* ptr, deleter_fn deleter, size_t size = 0);
+    // frees retired memory that no reader can reach any more
+    void reclaim();
+    int numPending() const {return int(m_retired.size());}
+
+private:
+    static const int MAXREADERS = 256;   // reader threads per manager
+    static const int RECLAIMBATCH = 64;  // retire() reclaims after this many new retirements
+    static const unsigned long INACTIVE = 0;
+
+    struct alignas(64) ReaderSlot{
+        atomic<bool> m_taken;            // held by a thread, released when that thread exits
+        atomic<unsigned long> m_epoch;   // epoch the reader entered in, INACTIVE outside
+    };
+    struct Retired{
+        void* m_ptr;
+        deleter_fn m_deleter;
+        size_t m_size;
+        unsigned long m_epoch;
+    };
+
+    ReaderSlot* readerSlot();
+
+    long m_id;                           // never reused, unlike the address of a destroyed manager
+    atomic<unsigned long> m_epoch;
+    // shared with the threads holding a slot, which release it on exit even after the manager is gone
+    shared_ptr<ReaderSlot[]> m_readers;
+    vector<Retired> m_retired;           // only touched by the writer
+    int m_sinceReclaim;
+};
+
+// enters an epoch for the lifetime of the object
+class EpochGuard{
+public:
+    explicit EpochGuard(EpochManager& epochs) : m_epochs(epochs) {m_epochs.enter();}
+    ~EpochGuard() {m_epochs.exit();}
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+private:
+    EpochManager& m_epochs;
+};
+#endif
@@ -0,0 +1,112 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "export.h"
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <unistd.h>
+
+static const char EXPORTMAGIC[8] = {'V', 'A', 'C', 'D', 'B', 'E', 'X', '1'};
+
+ExportSink fdSink(int fd) {
+    return [fd](const char *data, size_t size) {
+        while (size > 0) {
+            ssize_t result = write(fd, data, size);
+            if (result < 0 && errno != EINTR) {
+                return false;
+            } else if (result > 0) {
+                data += result;
+                size -= result;
+            }
+        }
+        return true;
+    };
+}
+
+ExportSink bufferSink(string &buffer) {
+    return [&buffer](const char *data, size_t size) {
+        buffer.append(data, size);
+        return true;
+    };
+}
+
+void appendExportHeader(string &out, export_t format) {
+    if (format == EXPORTCSV) {
+        out += "name,serial\n";
+    } else if (format == EXPORTBINARY) {
+        out.append(EXPORTMAGIC, sizeof(EXPORTMAGIC));
+    }
+}
+
+static void appendInt(string &out, int value) {
+    char digits[16];
+    char *end = to_chars(digits, digits + sizeof(digits), value).ptr;
+    out.append(digits, end - digits);
+}
+
+static void appendVarint(string &out, uint32_t value) {
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+static void appendCsvName(string &out, const string &name) {
+    //names are nearly always plain letters, only the others are quoted
+    if (name.find_first_of(",\"\r\n") == string::npos) {
+        out += name;
+        return;
+    }
+    out += '"';
+    for (char c: name) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+static void appendJsonName(string &out, const string &name) {
+    static const char hex[] = "0123456789abcdef";
+    for (char c: name) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        } else {
+            out += c;
+        }
+    }
+}
+
+void appendExportRecord(string &out, const string &name, int serial, export_t format) {
+    switch (format) {
+        case EXPORTCSV:
+            appendCsvName(out, name);
+            out += ',';
+            appendInt(out, serial);
+            out += '\n';
+            break;
+        case EXPORTJSONL:
+            out += "{\"name\":\"";
+            appendJsonName(out, name);
+            out += "\",\"serial\":";
+            appendInt(out, serial);
+            out += "}\n";
+            break;
+        case EXPORTBINARY:
+            appendVarint(out, uint32_t(name.size()));
+            out += name;
+            appendVarint(out, uint32_t(serial));
+            break;
+    }
+}
+
+bool exportSelects(const ExportOptions &options, const string &name, int serial) {
+    return serial >= options.minSerial && serial <= options.maxSerial &&
+           (options.name.empty() || name == options.name);
+}
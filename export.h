@@ -0,0 +1,41 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef EXPORT_H
+#define EXPORT_H
+#include <climits>
+#include <cstddef>
+#include <functional>
+#include <string>
+using namespace std;
+// output formats of VacDB::exportPatients()
+//   EXPORTCSV:    "name,serial" header, then one name,serial line per patient (RFC 4180 quoting)
+//   EXPORTJSONL:  one {"name":"...","serial":n} object per line
+//   EXPORTBINARY: "VACDBEX1", then per patient: varint name length, name bytes, varint serial
+enum export_t {EXPORTCSV, EXPORTJSONL, EXPORTBINARY};
+// which patients are exported and how
+struct ExportOptions{
+    export_t format = EXPORTCSV;
+    string   name;                  // only patients with this name (empty: every name)
+    int      minSerial = INT_MIN;   // only serial numbers in [minSerial, maxSerial]
+    int      maxSerial = INT_MAX;
+    int      numThreads = 0;        // formatting threads, <= 0 uses all hardware threads
+    size_t   bufferBytes = 1 << 20; // output is handed to the sink in pieces of at least this size
+};
+// outcome of an export
+struct ExportStats{
+    bool   success = false;         // false if the sink refused some output
+    long   records = 0;
+    size_t bytes = 0;
+    double seconds = 0;
+    double recordsPerSecond = 0;
+};
+// receives the output in order, returns false to stop the export
+typedef function<bool(const char*, size_t)> ExportSink;
+// writes to a file descriptor with write(2)
+ExportSink fdSink(int fd);
+// appends to buffer
+ExportSink bufferSink(string& buffer);
+// the bytes written before the first patient
+void appendExportHeader(string& out, export_t format);
+void appendExportRecord(string& out, const string& name, int serial, export_t format);
+bool exportSelects(const ExportOptions& options, const string& name, int serial);
+#endif
@@ -4,6 +4,20 @@
 #include <vector>
 #include <algorithm>
 #include <ctime>
+#include <set>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+#include "server.h"
+#include "client.h"
+#include "workload.h"
+#include "sharedvacdb.h"
+#include "combiner.h"
+#include "replication.h"
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 using namespace std;
 
@@ -100,9 +114,10 @@ public:
         // the parameter size specifies the length of string we ask for
         // to use ASCII char the number range in constructor must be set to 97 - 122
         // and the Random type must be UNIFORMINT (it is default in constructor)
-        string output = "";
+        string output;
+        output.reserve(size);
         for (int i = 0; i < size; i++) {
-            output = output + (char) getRandNum();
+            output += (char) getRandNum();
         }
         return output;
     }
@@ -120,6 +135,9 @@ private:
 
 
 unsigned int hashFunction(string str);
+unsigned int collidingHash(string str);
+unsigned int stringHash(string str);
+unsigned int throwingHash(string str);
 
 class Tester {
 public:
@@ -137,6 +155,48 @@ public:
     bool testRehashAfterRemoval();
     bool testRehashCompletionFromDeletedRatio();
 
+    bool testIteratorDuringRehash();
+    bool testParallelReports();
+
+    bool testResizePolicy();
+    bool testReserveAndMemoryBudget();
+
+    bool testConcurrentReaders();
+
+    bool testMigrationRouting();
+
+    bool testNegativeFilter();
+
+    bool testCheckpointDuringWrites();
+
+    bool testServerPipelining();
+
+    bool testWorkloadTrace();
+
+    bool testAdaptiveProbing();
+
+    bool testSharedMemory();
+
+    bool testRehashNow();
+
+    bool testTieredStorage();
+
+    bool testAggregates();
+
+    bool testExport();
+
+    bool testCombiner();
+    bool testThrowingCombiner();
+    bool testReplicationBacklog();
+    bool testReplicationFrameSize();
+
+    bool testReplication();
+
+    bool testProbeChainGuard();
+    bool testLongQuadraticWalk();
+
+    bool testCheckpointValidation();
+
 private:
     vector<Patient> insertMultiplePatients(VacDB &vaccineDatabase, int patientSize);
 
@@ -188,7 +248,8 @@ bool Tester::probe(unsigned int &index, string key, int serial, bool isCurrentTa
     }
 
     //calculate initial index
-    index = vaccineDatabase.m_hash(key) % capacity;
+    unsigned int hash = vaccineDatabase.hashOf(key, serial, vaccineDatabase.m_hashSeed);
+    index = hash % capacity;
 
     //loop through table until an empty slot or match is found
     for (int i = 1; hashTable[index] != nullptr; i++) {
@@ -207,11 +268,10 @@ bool Tester::probe(unsigned int &index, string key, int serial, bool isCurrentTa
                 index = (index + 1) % capacity;
                 break;
             case QUADRATIC:
-                index = (index + i * i) % capacity;
+                index = (index + uint64_t(i) * i) % capacity;
                 break;
             case DOUBLEHASH:
-                index = ((vaccineDatabase.m_hash(key) % capacity) + i * (11 - (vaccineDatabase.m_hash(key) % 11))) %
-                        capacity;
+                index = ((hash % capacity) + uint64_t(i) * (11 - (hash % 11))) % capacity;
                 break;
         }
     }
@@ -403,8 +463,10 @@ bool Tester::testRehashCompletionFromDeletedRatio() {
     int initialCapacity = vaccineDatabase.m_currentCap;
 
     //delete a large number of nodes so that rehash will finish
+    //(indices wrap around so the later calls exercise removal of already-deleted patients)
     for (int i = 0; i < 500; i++) {
-        vaccineDatabase.remove(vaccineDatabase.getPatient(patientVector[i].getKey(),patientVector[i].getSerial()));
+        Patient &patient = patientVector[i % patientVector.size()];
+        vaccineDatabase.remove(vaccineDatabase.getPatient(patient.getKey(), patient.getSerial()));
     }
 
     Patient** finalPointer = vaccineDatabase.m_currentTable;
@@ -417,6 +479,1169 @@ bool Tester::testRehashCompletionFromDeletedRatio() {
     return false;
 }
 
+bool Tester::testIteratorDuringRehash() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, DOUBLEHASH);
+
+    //insert 51 nodes so that the patients are split between the old and the new table
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 51);
+    if (vaccineDatabase.m_transferIndex == -1) {
+        return false;
+    }
+
+    //every patient must be visited exactly once
+    set<pair<string, int>> visited;
+    int numVisited = 0;
+    for (const Patient &patient: vaccineDatabase) {
+        visited.insert(make_pair(patient.getKey(), patient.getSerial()));
+        numVisited++;
+    }
+    for (Patient &patient: patientVector) {
+        if (visited.count(make_pair(patient.getKey(), patient.getSerial())) == 0) {
+            return false;
+        }
+    }
+    return numVisited == int(visited.size()) && numVisited == int(patientVector.size());
+}
+
+bool Tester::testParallelReports() {
+    //insert enough patients for the slots to be split across several threads
+    VacDB vaccineDatabase(MINPRIME, hashFunction, LINEAR);
+    insertMultiplePatients(vaccineDatabase, 5000);
+
+    //compare the parallel reports against a sequential scan
+    map<string, int> namesExpected;
+    map<int, int> serialsExpected;
+    for (const Patient &patient: vaccineDatabase) {
+        namesExpected[patient.getKey()]++;
+        serialsExpected[patient.getSerial()]++;
+    }
+
+    int total = vaccineDatabase.parallelReduce(0, [](int &sum, const Patient &) { sum++; },
+                                               [](int &result, int partial) { result += partial; }, 4);
+
+    return vaccineDatabase.numWorkers(4) > 1 && total == 5000 &&
+           vaccineDatabase.countByName(4) == namesExpected && vaccineDatabase.countBySerial(4) == serialsExpected;
+}
+
+bool Tester::testResizePolicy() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, DOUBLEHASH);
+
+    //thresholds that would trigger another resize right after a rehash are rejected
+    ResizePolicy unstable;
+    unstable.growthFactor = 1.5;
+    if (vaccineDatabase.setResizePolicy(unstable)) {
+        return false;
+    }
+
+    ResizePolicy policy;
+    policy.growThreshold = 0.7;
+    policy.shrinkThreshold = 0.2;
+    policy.growthFactor = 2;
+    if (!vaccineDatabase.setResizePolicy(policy, DOUBLEHASH)) {
+        return false;
+    }
+
+    //71 patients exceed the grow threshold of 0.7 (and not before)
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 70);
+    if (vaccineDatabase.m_transferIndex != -1) {
+        return false;
+    }
+    insertMultiplePatients(vaccineDatabase, 80);
+    while (vaccineDatabase.m_transferIndex != -1) {
+        vaccineDatabase.rehash();
+    }
+    int grownCapacity = vaccineDatabase.m_currentCap;
+    if (grownCapacity > 2 * 80) {
+        return false;
+    }
+
+    //removing most patients drops the live load below the shrink threshold, the table shrinks
+    for (int i = 0; i < 60; i++) {
+        vaccineDatabase.remove(patientVector[i]);
+    }
+    while (vaccineDatabase.m_transferIndex != -1) {
+        vaccineDatabase.rehash();
+    }
+    return vaccineDatabase.m_currentCap < grownCapacity;
+}
+
+bool Tester::testReserveAndMemoryBudget() {
+    //(hashFunction collides for long names, which would set off the chain guard)
+    VacDB vaccineDatabase(MINPRIME, stringHash, LINEAR);
+
+    //after reserving room for 1000 patients, inserting them never starts a rehash
+    vaccineDatabase.reserve(1000);
+    Patient **reservedTable = vaccineDatabase.m_currentTable;
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 1000);
+    if (vaccineDatabase.m_currentTable != reservedTable || vaccineDatabase.m_oldTable != nullptr) {
+        return false;
+    }
+
+    //a small budget stops growth, and patients beyond it are refused
+    VacDB budgetDatabase(MINPRIME, stringHash, LINEAR);
+    ResizePolicy policy;
+    policy.maxBytes = 8192;
+    budgetDatabase.setResizePolicy(policy);
+    int numInserted = 0;
+    for (Patient &patient: patientVector) {
+        if (budgetDatabase.insert(patient)) {
+            numInserted++;
+        }
+    }
+    return numInserted > 0 && numInserted < 1000 && budgetDatabase.footprint() <= policy.maxBytes;
+}
+
+bool Tester::testConcurrentReaders() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    vector<Patient> resident = insertMultiplePatients(vaccineDatabase, 200);
+    vaccineDatabase.enableConcurrentReaders();
+
+    //readers look up the resident patients while the writer keeps rehashing the tables
+    atomic<bool> stop(false);
+    atomic<int> misses(0);
+    vector<thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&]() {
+            while (!stop) {
+                for (Patient &patient: resident) {
+                    if (!(vaccineDatabase.getPatient(patient.getKey(), patient.getSerial()) == patient)) {
+                        misses++;
+                    }
+                }
+            }
+        });
+    }
+
+    Random randKeyObject(65, 90);
+    vector<Patient> churn;
+    for (int i = 0; i < 3000; i++) {
+        churn.push_back(Patient(randKeyObject.getRandString(8), MINID + i, true));
+        vaccineDatabase.insert(churn.back());
+        if (i >= 100) {
+            vaccineDatabase.remove(churn[i - 100]);
+        }
+    }
+    stop = true;
+    for (thread &reader: readers) {
+        reader.join();
+    }
+
+    //with no reader left, everything retired can be freed
+    vaccineDatabase.m_epochs->reclaim();
+    bool result = misses == 0 && vaccineDatabase.m_epochs->numPending() == 0;
+
+    //exited threads give their reader slot back, so short-lived readers never run out of slots
+    for (int i = 0; result && i < 300; i++) {
+        thread reader([&]() {
+            if (!(vaccineDatabase.getPatient(resident[0].getKey(), resident[0].getSerial()) == resident[0])) {
+                misses++;
+            }
+        });
+        reader.join();
+    }
+
+    //a manager allocated where a destroyed one was does not inherit its slots
+    for (int round = 0; result && round < 20; round++) {
+        EpochManager *epochs = new EpochManager();
+        epochs->enter();
+        epochs->exit();
+        delete epochs;
+    }
+    return result && misses == 0;
+}
+
+bool Tester::testMigrationRouting() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, LINEAR);
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 51);
+    Patient missing("Ymir", 1234, true);
+
+    //every transfer step must keep all patients reachable, and misses should skip the drained part of the old table
+    while (vaccineDatabase.m_transferIndex != -1) {
+        for (Patient &patient: patientVector) {
+            if (!(vaccineDatabase.getPatient(patient.getKey(), patient.getSerial()) == patient)) {
+                return false;
+            }
+            vaccineDatabase.getPatient(patient.getKey(), MINID - 1);
+        }
+        //a failed insert still moves the transfer forward
+        vaccineDatabase.insert(patientVector[0]);
+    }
+    if (vaccineDatabase.getStats().oldProbesSkipped == 0) {
+        return false;
+    }
+
+    //removing and re-inserting after the transfer must not find stale copies
+    return vaccineDatabase.remove(patientVector[1]) && !vaccineDatabase.remove(patientVector[1]) &&
+           vaccineDatabase.insert(patientVector[1]) && !vaccineDatabase.insert(patientVector[1]) &&
+           !vaccineDatabase.remove(missing);
+}
+
+bool Tester::testNegativeFilter() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    vector<Patient> firstPatients = insertMultiplePatients(vaccineDatabase, 30);
+    vaccineDatabase.enableNegativeFilter(10);
+
+    //patients inserted before and after enabling the filter, across several rehashes, must all be found
+    Random randKeyObject(65, 90);
+    vector<Patient> patientVector;
+    for (int i = 0; i < 500; i++) {
+        patientVector.push_back(Patient(randKeyObject.getRandString(8), MINID + i, true));
+        if (!vaccineDatabase.insert(patientVector.back())) {
+            return false;
+        }
+    }
+    patientVector.insert(patientVector.end(), firstPatients.begin(), firstPatients.end());
+    for (Patient &patient: patientVector) {
+        if (!(vaccineDatabase.getPatient(patient.getKey(), patient.getSerial()) == patient)) {
+            return false;
+        }
+    }
+
+    //removed patients are gone and can be inserted again
+    if (!vaccineDatabase.remove(patientVector[0]) || !vaccineDatabase.getPatient(patientVector[0].getKey(),
+                                                                                  patientVector[0].getSerial()).getKey().empty() ||
+        !vaccineDatabase.insert(patientVector[0])) {
+        return false;
+    }
+
+    //nearly all lookups of absent patients are answered by the filter
+    VacDBStats before = vaccineDatabase.getStats();
+    for (Patient &patient: patientVector) {
+        vaccineDatabase.getPatient(patient.getKey(), MINID - 1);
+    }
+    VacDBStats after = vaccineDatabase.getStats();
+    long negatives = after.filterNegatives - before.filterNegatives;
+    long falsePositives = after.filterFalsePositives - before.filterFalsePositives;
+    return after.filterBytes > 0 && after.filterExpectedFalsePositiveRate < 0.05 &&
+           double(falsePositives) / double(negatives + falsePositives) < 0.05;
+}
+
+bool Tester::testCheckpointDuringWrites() {
+    //take the checkpoint while a rehash is in progress
+    VacDB vaccineDatabase(MINPRIME, hashFunction, DOUBLEHASH);
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 51);
+    vaccineDatabase.remove(patientVector[0]);
+    int transferIndex = vaccineDatabase.m_transferIndex;
+    if (transferIndex == -1 || !vaccineDatabase.startCheckpoint("mytest_checkpoint.bin")) {
+        return false;
+    }
+
+    //writes made after the snapshot must not end up in the checkpoint
+    Patient later("Ymir", 1234, true);
+    vaccineDatabase.insert(later);
+    vaccineDatabase.remove(patientVector[1]);
+    CheckpointStats stats = vaccineDatabase.finishCheckpoint();
+
+    VacDB restored(MINPRIME, hashFunction, LINEAR);
+    bool loaded = stats.success && stats.bytes > 0 && restored.loadCheckpoint("mytest_checkpoint.bin");
+    std::remove("mytest_checkpoint.bin");
+    if (!loaded || restored.m_transferIndex != transferIndex || restored.m_currProbing != DOUBLEHASH ||
+        !restored.getPatient(later.getKey(), later.getSerial()).getKey().empty() ||
+        !restored.getPatient(patientVector[0].getKey(), patientVector[0].getSerial()).getKey().empty()) {
+        return false;
+    }
+    for (unsigned int i = 1; i < patientVector.size(); i++) {
+        if (!(restored.getPatient(patientVector[i].getKey(), patientVector[i].getSerial()) == patientVector[i])) {
+            return false;
+        }
+    }
+
+    //the restored table finishes the interrupted rehash on its own
+    while (restored.m_transferIndex != -1) {
+        restored.insert(patientVector[1]);
+    }
+    return restored.getPatient(patientVector[50].getKey(), patientVector[50].getSerial()) == patientVector[50];
+}
+
+bool Tester::testCheckpointValidation() {
+    VacDB vaccineDatabase(MINPRIME, stringHash, LINEAR);
+    insertMultiplePatients(vaccineDatabase, 40);
+    if (vaccineDatabase.m_currMaxProbe == 0 || !vaccineDatabase.startCheckpoint("mytest_validation.bin") ||
+        !vaccineDatabase.finishCheckpoint().success) {
+        return false;
+    }
+    ifstream in("mytest_validation.bin", ios::binary);
+    string image((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    //each damaged copy sets one int32 of the header or of the first entry: transfer index, deleted count
+    //and max probe of the current table, serial number of the first entry
+    const int transferOffset = 12, deletedOffset = 28, maxProbeOffset = 36, serialOffset = 64;
+    vector<pair<int, int32_t>> damages = {{transferOffset, -5}, {deletedOffset, 1000}, {maxProbeOffset, 0},
+                                          {serialOffset, MAXID + 1}};
+    VacDB restored(MINPRIME, stringHash, LINEAR);
+    Patient resident("Ymir", 1234, true);
+    restored.insert(resident);
+    bool result = true;
+    for (pair<int, int32_t> &damage: damages) {
+        string damaged = image;
+        memcpy(&damaged[damage.first], &damage.second, sizeof(int32_t));
+        ofstream out("mytest_validation.bin", ios::binary | ios::trunc);
+        out.write(damaged.data(), damaged.size());
+        out.close();
+        //a rejected file leaves the table as it was
+        result = result && !restored.loadCheckpoint("mytest_validation.bin") && restored.numPatients() == 1 &&
+                 restored.getPatient(resident.getKey(), resident.getSerial()) == resident;
+    }
+
+    //the undamaged image still loads
+    ofstream out("mytest_validation.bin", ios::binary | ios::trunc);
+    out.write(image.data(), image.size());
+    out.close();
+    result = result && restored.loadCheckpoint("mytest_validation.bin") && restored.numPatients() == 40;
+
+    //inflated size and deleted counts in the header are replaced by the counts of the entries
+    const int sizeOffset = 24;
+    int32_t inflated = vaccineDatabase.m_currentCap;
+    string counted = image;
+    memcpy(&counted[sizeOffset], &inflated, sizeof(int32_t));
+    memcpy(&counted[deletedOffset], &inflated, sizeof(int32_t));
+    out.open("mytest_validation.bin", ios::binary | ios::trunc);
+    out.write(counted.data(), counted.size());
+    out.close();
+    result = result && restored.loadCheckpoint("mytest_validation.bin") && restored.m_currentSize == 40 &&
+             restored.m_currNumDeleted == 0;
+
+    //a patient of the old table below the transfer index was moved already, a live copy there is rejected
+    VacDB transferring(MINPRIME, stringHash, LINEAR);
+    Random randKeyObject(97, 122);
+    for (int i = MINID; transferring.m_transferIndex <= 0; i++) {
+        transferring.insert(Patient(randKeyObject.getRandString(10), i, true));
+    }
+    result = result && transferring.startCheckpoint("mytest_validation.bin") && transferring.finishCheckpoint().success;
+    in.close();
+    in.open("mytest_validation.bin", ios::binary);
+    string transferImage((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    //entries are {int32 slot, int32 serial, uint8 used, uint32 length, name}, each table ends with slot -1
+    const int entriesOffset = 60;
+    size_t position = entriesOffset;
+    int table = 0;
+    size_t movedUsed = 0;
+    while (result && table < 2 && movedUsed == 0 && position + 4 <= transferImage.size()) {
+        int32_t slot = 0;
+        uint32_t length = 0;
+        memcpy(&slot, &transferImage[position], sizeof(slot));
+        if (slot == -1) {
+            table++;
+            position += 4;
+            continue;
+        }
+        memcpy(&length, &transferImage[position + 9], sizeof(length));
+        if (table == 1 && slot < transferring.m_transferIndex && transferImage[position + 8] == 0) {
+            movedUsed = position + 8;
+        }
+        position += 13 + length;
+    }
+    result = result && movedUsed != 0;
+    if (result) {
+        transferImage[movedUsed] = 1;
+        out.open("mytest_validation.bin", ios::binary | ios::trunc);
+        out.write(transferImage.data(), transferImage.size());
+        out.close();
+        result = !restored.loadCheckpoint("mytest_validation.bin") && restored.numPatients() == 40;
+    }
+    std::remove("mytest_validation.bin");
+    return result;
+}
+
+bool Tester::testServerPipelining() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, DOUBLEHASH);
+    VacDBServer server(vaccineDatabase);
+    string path = "/tmp/mytest_vacdb_" + to_string(getpid()) + ".sock";
+    if (!server.listenUnix(path)) {
+        return false;
+    }
+    thread serverThread([&server]() { server.run(); });
+
+    VacDBClient client;
+    bool result = client.connectUnix(path);
+
+    //pipeline 100 single inserts before reading any response
+    Random randKeyObject(97, 122);
+    vector<Patient> patientVector;
+    for (int i = 0; result && i < 100; i++) {
+        patientVector.push_back(Patient(randKeyObject.getRandString(10), MINID + i, true));
+        client.send(OP_INSERT, vector<Patient>(1, patientVector.back()));
+    }
+    for (int i = 0; result && i < 100; i++) {
+        Response response;
+        result = client.receive(response) && response.id == uint32_t(i + 1) && response.statuses.size() == 1 &&
+                 response.statuses[0] == 1;
+    }
+
+    //a batch lookup answers every patient in order, including a missing one
+    vector<Patient> lookups(patientVector.begin(), patientVector.begin() + 10);
+    lookups.push_back(Patient("Ymir", 1234, true));
+    client.send(OP_BATCHGET, lookups);
+    Response response;
+    result = result && client.receive(response) && response.patients.size() == 11 && response.statuses[10] == 0 &&
+             response.patients[10].getKey().empty();
+    for (int i = 0; result && i < 10; i++) {
+        result = response.statuses[i] == 1 && response.patients[i] == patientVector[i];
+    }
+
+    //names over 0xFFFF bytes and frames over MAXFRAME cannot be encoded, nothing is queued for them
+    Request oversized;
+    oversized.op = OP_BATCHINSERT;
+    oversized.patients.push_back(Patient(string(0x10000, 'a'), MINID, true));
+    string encoded = "x";
+    result = result && !encodeRequest(oversized, encoded) && encoded == "x";
+    oversized.patients.assign(MAXFRAME / 0xFFFF + 1, Patient(string(0xFFFF, 'a'), MINID, true));
+    result = result && !encodeRequest(oversized, encoded) && encoded == "x" &&
+             client.send(OP_BATCHINSERT, oversized.patients) == 0 && client.outstanding() == 0;
+
+    //single round trips
+    result = result && !client.insert(patientVector[0]) && client.remove(patientVector[0]) &&
+             client.getPatient(patientVector[0].getKey(), patientVector[0].getSerial()).getKey().empty() &&
+             client.getPatient(patientVector[1].getKey(), patientVector[1].getSerial()) == patientVector[1];
+
+    //a frame shorter than any request is malformed, the server closes the connection instead of waiting
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    char emptyFrame[4] = {0, 0, 0, 0};
+    char reply;
+    result = result && connect(fd, (sockaddr *) &address, sizeof(address)) == 0 &&
+             write(fd, emptyFrame, sizeof(emptyFrame)) == 4 && read(fd, &reply, 1) == 0;
+    close(fd);
+
+    server.stop();
+    serverThread.join();
+    return result && server.requestsServed() == 105;
+}
+
+bool Tester::testWorkloadTrace() {
+    WorkloadSpec spec;
+    spec.numKeys = 1000;
+    spec.distribution = ZIPFIANKEYS;
+    WorkloadGenerator generator(spec);
+    string path = "/tmp/mytest_vacdb_" + to_string(getpid()) + ".trace";
+
+    //record a Zipfian workload; rank 0 should get far more than its uniform share of 1/1000
+    vector<TraceRecord> records;
+    TraceWriter writer;
+    bool result = writer.open(path);
+    int hottest = 0;
+    for (int i = 0; result && i < 20000; i++) {
+        records.push_back(generator.next());
+        result = writer.write(records.back());
+        if (records.back().patient == generator.keyPatient(0)) {
+            hottest++;
+        }
+    }
+    result = result && writer.close() && writer.count() == 20000 && hottest > 1000;
+
+    //the trace reads back record for record
+    TraceReader reader;
+    TraceRecord record;
+    result = result && reader.open(path);
+    for (size_t i = 0; result && i < records.size(); i++) {
+        result = reader.next(record) && record.op == records[i].op && record.patient == records[i].patient &&
+                 record.delayMicros == records[i].delayMicros &&
+                 (record.op != TRACE_UPDATE || record.newSerial == records[i].newSerial);
+    }
+    result = result && !reader.next(record);
+
+    //replaying at full speed gives the same outcomes as applying the operations directly
+    //(hashFunction sets off the chain guard, whose seeds are only repeatable when asked for)
+    VacDB replayed(MINPRIME, hashFunction, DEFPOLCY);
+    VacDB direct(MINPRIME, hashFunction, DEFPOLCY);
+    replayed.setDeterministicSeeds(true);
+    direct.setDeterministicSeeds(true);
+    long succeeded[4] = {0, 0, 0, 0};
+    for (TraceRecord &each: records) {
+        succeeded[each.op] += applyRecord(direct, each);
+    }
+    TraceReader replayReader;
+    result = result && replayReader.open(path);
+    ReplayStats stats = replayTrace(replayReader, replayed, 0, 0);
+    result = result && stats.total() == 20000 && replayed.m_currentSize == direct.m_currentSize;
+    for (int op = TRACE_INSERT; result && op <= TRACE_UPDATE; op++) {
+        result = stats.succeeded[op] == succeeded[op];
+    }
+
+    //a timed replay holds back to the requested rate: 200 operations at 20000/s take at least 10ms
+    writer.open(path);
+    for (int i = 0; i < 200; i++) {
+        writer.write(records[i]);
+    }
+    //names are not cut to a byte's length
+    TraceRecord longName;
+    longName.patient = Patient(string(300, 'q'), MINID, true);
+    result = result && writer.write(longName);
+    writer.close();
+    TraceReader longReader;
+    result = result && longReader.open(path);
+    for (int i = 0; result && i <= 200; i++) {
+        result = longReader.next(record);
+    }
+    result = result && record.patient == longName.patient && record.patient.getKey().size() == 300;
+    VacDB timed(MINPRIME, hashFunction, DEFPOLCY);
+    TraceReader timedReader;
+    result = result && timedReader.open(path);
+    stats = replayTrace(timedReader, timed, 0, 20000);
+    unlink(path.c_str());
+    return result && stats.total() == 201 && stats.seconds >= 0.0099;
+}
+
+bool Tester::testAdaptiveProbing() {
+    //the letter sum crowds every home slot into a few hundred neighbours, which linear probing handles worst
+    hash_fn weakHash = [](string key) {
+        unsigned int val = 0;
+        for (char c: key) {
+            val += (unsigned char) c;
+        }
+        return val;
+    };
+    VacDB vaccineDatabase(MINPRIME, weakHash, LINEAR);
+    vaccineDatabase.setAdaptiveProbing(true);
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 3000);
+    for (Patient &patient: patientVector) {
+        vaccineDatabase.getPatient(patient.getKey(), patient.getSerial());
+    }
+    vaccineDatabase.reserve(6000);
+
+    //every rehash decided, and the last one on the cheapest predicted policy
+    VacDBStats stats = vaccineDatabase.getStats();
+    const ProbingDecision &decision = stats.lastProbingDecision;
+    bool result = stats.probingDecisions > 0 && decision.chosen != LINEAR &&
+                  vaccineDatabase.m_currProbing == decision.chosen && decision.sampledKeys > 0 &&
+                  decision.missFraction > 0 && decision.missFraction < 1 &&
+                  decision.capacity == vaccineDatabase.m_currentCap;
+    for (int policy = QUADRATIC; result && policy <= LINEAR; policy++) {
+        result = decision.predictedCost[decision.chosen] <= decision.predictedCost[policy];
+    }
+
+    //nothing is lost by switching policies
+    for (Patient &patient: patientVector) {
+        result = result && vaccineDatabase.getPatient(patient.getKey(), patient.getSerial()) == patient;
+    }
+
+    //an explicit policy wins over the adaptive choice
+    vaccineDatabase.changeProbPolicy(LINEAR);
+    return result && !vaccineDatabase.adaptiveProbing();
+}
+
+bool Tester::testSharedMemory() {
+    string name = "/mytest_vacdb_" + to_string(getpid());
+    SharedVacDB writer;
+    if (!writer.create(name, 1 << 22, hashFunction, DOUBLEHASH)) {
+        return false;
+    }
+    VacDB resident(MINPRIME, hashFunction, DOUBLEHASH);
+    vector<Patient> residents = insertMultiplePatients(resident, 200);
+    bool result = writer.copyFrom(resident) && writer.numEntries() == resident.m_currentSize;
+
+    //a reader process keeps finding the residents while the writer grows and shrinks the table
+    pid_t child = fork();
+    if (child == 0) {
+        SharedVacDB reader;
+        bool found = reader.open(name, hashFunction) && reader.readOnly() && !reader.insert(Patient("Ymir", 1234, true));
+        for (int round = 0; found && round < 200; round++) {
+            for (Patient &patient: residents) {
+                found = found && reader.getPatient(patient.getKey(), patient.getSerial()) == patient;
+            }
+        }
+        _exit(found ? 0 : 1);
+    }
+    Random randKeyObject(97, 122);
+    vector<Patient> churn;
+    for (int i = 0; i < 3000; i++) {
+        churn.push_back(Patient(randKeyObject.getRandString(10), MINID + i % 1000, true));
+        writer.insert(churn.back());
+    }
+    for (int i = 0; i < 2000; i++) {
+        result = result && writer.remove(churn[i]);
+    }
+    int status = -1;
+    result = result && child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) &&
+             WEXITSTATUS(status) == 0;
+
+    //a reader mapped afterwards sees the final table
+    SharedVacDB reader;
+    result = result && reader.open(name, hashFunction) && writer.generation() > 0 &&
+             reader.generation() == writer.generation() && reader.numEntries() == writer.numEntries() &&
+             reader.getPatient(churn[0].getKey(), churn[0].getSerial()).getKey().empty() &&
+             reader.getPatient(churn[2999].getKey(), churn[2999].getSerial()) == churn[2999] &&
+             reader.getPatient(residents[0].getKey(), residents[0].getSerial()) == residents[0];
+
+    //replacing the segment with a smaller one leaves the mapped reader on its old copy
+    SharedVacDB replacement;
+    result = result && replacement.create(name, 1 << 16, hashFunction, DOUBLEHASH) &&
+             replacement.numEntries() == 0 &&
+             reader.getPatient(churn[2999].getKey(), churn[2999].getSerial()) == churn[2999];
+
+    //names longer than a byte can count are refused
+    result = result && !replacement.insert(Patient(string(256, 'q'), MINID, true)) &&
+             replacement.insert(Patient(string(255, 'q'), MINID, true));
+    //once the table cannot grow any further the insert fails and leaves the patient out
+    int inserted = 1;
+    Patient refused;
+    for (int i = 0; result && refused.getKey().empty() && i < 100000; i++) {
+        Patient patient(randKeyObject.getRandString(10) + to_string(i), MINID + i % 1000, true);
+        if (replacement.insert(patient)) {
+            inserted++;
+        } else {
+            refused = patient;
+        }
+    }
+    result = result && !refused.getKey().empty() && replacement.numEntries() == inserted &&
+             replacement.capacity() >= 2 * inserted &&
+             replacement.getPatient(refused.getKey(), refused.getSerial()).getKey().empty();
+    SharedVacDB::unlink(name);
+    return result;
+}
+
+bool Tester::testRehashNow() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 6000);
+    //a bulk delete leaves soft-deleted entries behind
+    for (int i = 0; i < 2000; i++) {
+        vaccineDatabase.remove(patientVector[i]);
+    }
+    int live = 0;
+    for (auto it = vaccineDatabase.begin(); it != vaccineDatabase.end(); ++it) {
+        live++;
+    }
+
+    //switch policy and rebuild with four workers
+    vaccineDatabase.changeProbPolicy(LINEAR);
+    bool result = vaccineDatabase.rehashNow(4);
+    VacDBStats stats = vaccineDatabase.getStats();
+    result = result && vaccineDatabase.m_oldTable == nullptr && vaccineDatabase.m_transferIndex == -1 &&
+             vaccineDatabase.m_currProbing == LINEAR && vaccineDatabase.m_currNumDeleted == 0 &&
+             vaccineDatabase.m_currentSize == live && stats.parallelRehashes == 1 &&
+             stats.parallelDeferred >= 0 && stats.parallelDeferred < live;
+
+    //every live patient is reachable through the normal probe sequence, the removed ones are gone
+    for (int i = 0; result && i < int(patientVector.size()); i++) {
+        Patient found = vaccineDatabase.getPatient(patientVector[i].getKey(), patientVector[i].getSerial());
+        result = i < 2000 ? found.getKey().empty() : found == patientVector[i];
+    }
+    int slotsUsed = 0;
+    for (int i = 0; i < vaccineDatabase.m_currentCap; i++) {
+        slotsUsed += vaccineDatabase.m_currentTable[i] != nullptr;
+    }
+    return result && slotsUsed == live;
+}
+
+bool Tester::testTieredStorage() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    bool result = vaccineDatabase.enableTiering("/tmp/vacdb_mytest.cold");
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 2000);
+    //the first half is looked up again, so the second half is the coldest
+    for (int i = 0; i < 1000; i++) {
+        vaccineDatabase.getPatient(patientVector[i].getKey(), patientVector[i].getSerial());
+    }
+    result = result && vaccineDatabase.demoteColdest(900) == 900;
+    TierStats stats = vaccineDatabase.getTierStats();
+    result = result && stats.hotEntries == 1100 && stats.coldEntries == 900 && stats.demotions == 1 &&
+             stats.coldFileBytes > 0 && stats.memorySavedBytes > 0 && vaccineDatabase.m_oldTable == nullptr;
+
+    //the recently used patients stayed in memory, every patient is still found
+    for (int i = 0; result && i < 2000; i++) {
+        unsigned int index = 0;
+        result = i >= 1000 || probe(index, patientVector[i].getKey(), patientVector[i].getSerial(), true, vaccineDatabase);
+        result = result && vaccineDatabase.getPatient(patientVector[i].getKey(), patientVector[i].getSerial()) ==
+                           patientVector[i];
+    }
+
+    //a demoted patient is not inserted twice and can be removed
+    int demoted = 1000;
+    for (unsigned int index = 0; probe(index, patientVector[demoted].getKey(), patientVector[demoted].getSerial(), true,
+                                       vaccineDatabase);) {
+        demoted++;
+    }
+    result = result && !vaccineDatabase.insert(patientVector[demoted]);
+    result = result && vaccineDatabase.remove(patientVector[demoted]) && !vaccineDatabase.remove(patientVector[demoted]);
+    result = result && vaccineDatabase.getPatient(patientVector[demoted].getKey(), patientVector[demoted].getSerial())
+                           .getKey().empty();
+    stats = vaccineDatabase.getTierStats();
+    result = result && stats.coldEntries == 899 && stats.coldHits > 0 && stats.coldMisses > 0;
+
+    //later demotions add runs that are merged once they catch up with the run below
+    result = result && vaccineDatabase.demoteColdest(100) == 100;
+    stats = vaccineDatabase.getTierStats();
+    result = result && stats.coldRuns == 2 && stats.mergedPatients == 0 && stats.coldEntries == 999;
+    result = result && vaccineDatabase.demoteColdest(400) == 400;
+    stats = vaccineDatabase.getTierStats();
+    result = result && stats.coldRuns == 1 && stats.mergedPatients == 500 + 1399 && stats.coldEntries == 1399;
+    for (int i = 0; result && i < 2000; i++) {
+        bool removed = i == demoted;
+        result = vaccineDatabase.getPatient(patientVector[i].getKey(), patientVector[i].getSerial()).getKey().empty() ==
+                 removed;
+    }
+    result = result && vaccineDatabase.numPatients() == 1999;
+
+    //a hot table limit demotes as patients arrive, the demoted slots wait for the deleted-ratio rehash
+    TieringPolicy policy;
+    policy.maxHotEntries = 500;
+    VacDB limitedDatabase(MINPRIME, hashFunction, QUADRATIC);
+    result = result && limitedDatabase.enableTiering("/tmp/vacdb_mytest_limited.cold", policy);
+    vector<Patient> limitedPatients = insertMultiplePatients(limitedDatabase, 3000);
+    stats = limitedDatabase.getTierStats();
+    result = result && stats.demotions > 1 && stats.hotEntries <= 500 && stats.hotEntries + stats.coldEntries == 3000 &&
+             limitedDatabase.getStats().parallelRehashes == 0;
+    for (int i = 0; result && i < 3000; i++) {
+        result = limitedDatabase.getPatient(limitedPatients[i].getKey(), limitedPatients[i].getSerial()) ==
+                 limitedPatients[i];
+    }
+    return result;
+}
+
+bool Tester::testAggregates() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 1000);
+    //counts taken when aggregates are enabled, then kept up to date through rehashes
+    vaccineDatabase.enableAggregates();
+    vector<Patient> morePatients = insertMultiplePatients(vaccineDatabase, 2000);
+    patientVector.insert(patientVector.end(), morePatients.begin(), morePatients.end());
+    for (int i = 0; i < 3000; i += 3) {
+        vaccineDatabase.remove(patientVector[i]);
+    }
+
+    //re-keying moves a patient to its new serial number
+    Patient patient = patientVector[1];
+    int newSerial = patient.getSerial() == MAXID ? MINID : patient.getSerial() + 1;
+    bool result = vaccineDatabase.updateSerialNumber(patient, newSerial) &&
+                  vaccineDatabase.getPatient(patient.getKey(), patient.getSerial()).getKey().empty() &&
+                  vaccineDatabase.getPatient(patient.getKey(), newSerial).getSerial() == newSerial;
+    result = result && !vaccineDatabase.updateSerialNumber(Patient(patient.getKey(), newSerial, true), MAXID + 1) &&
+             !vaccineDatabase.updateSerialNumber(patient, newSerial);
+
+    //the counts agree with a full scan, also in the middle of a rehash
+    map<string, int> byName = vaccineDatabase.countByName();
+    map<int, int> bySerial = vaccineDatabase.countBySerial();
+    int live = 0;
+    for (const auto &count: byName) {
+        live += count.second;
+        result = result && vaccineDatabase.countOfName(count.first) == count.second;
+    }
+    for (int serial = MINID; serial <= MAXID; serial++) {
+        result = result && vaccineDatabase.countOfSerial(serial) == (bySerial.count(serial) ? bySerial[serial] : 0);
+    }
+    result = result && vaccineDatabase.numPatients() == live && vaccineDatabase.numNames() == int(byName.size()) &&
+             vaccineDatabase.countOfName("nobody") == 0;
+
+    //a table without aggregates still knows its live total
+    VacDB plainDatabase(MINPRIME, hashFunction, QUADRATIC);
+    vector<Patient> plainPatients = insertMultiplePatients(plainDatabase, 500);
+    for (int i = 0; i < 100; i++) {
+        plainDatabase.remove(plainPatients[i]);
+    }
+    //patients passed in with the used flag cleared are stored live, one by one and in bulk
+    Random randKeyObject(97, 122);
+    vector<Patient> unusedPatients;
+    for (int i = 0; i < MINBULKINSERT + 10; i++) {
+        unusedPatients.push_back(Patient(randKeyObject.getRandString(10), MINID + i, false));
+    }
+    result = result && plainDatabase.insert(unusedPatients.back());
+    unusedPatients.pop_back();
+    result = result && plainDatabase.insertBulk(unusedPatients) == int(unusedPatients.size()) &&
+             plainDatabase.getPatient(unusedPatients[0].getKey(), unusedPatients[0].getSerial()).getUsed();
+    int plainLive = 0;
+    for (auto it = plainDatabase.begin(); it != plainDatabase.end(); ++it) {
+        plainLive++;
+    }
+    return result && plainDatabase.numPatients() == plainLive && plainLive == 400 + MINBULKINSERT + 10 &&
+           plainDatabase.countOfName("nobody") == -1;
+}
+
+bool Tester::testExport() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    vector<Patient> patientVector = insertMultiplePatients(vaccineDatabase, 6000);
+    for (int i = 0; i < 6000; i += 4) {
+        vaccineDatabase.remove(patientVector[i]);
+    }
+    Patient quoted("doe, \"jane\"", 5000, true);
+    vaccineDatabase.insert(quoted);
+
+    //one CSV line per live patient after the header, whatever the number of threads
+    ExportOptions options;
+    options.bufferBytes = 4096;
+    string csv, csvParallel;
+    options.numThreads = 1;
+    ExportStats stats = vaccineDatabase.exportPatients(bufferSink(csv), options);
+    options.numThreads = 4;
+    vaccineDatabase.exportPatients(bufferSink(csvParallel), options);
+    long live = 0;
+    for (auto it = vaccineDatabase.begin(); it != vaccineDatabase.end(); ++it) {
+        live++;
+    }
+    bool result = stats.success && stats.records == live && stats.bytes == csv.size() && csv == csvParallel &&
+                  csv.compare(0, 12, "name,serial\n") == 0 && count(csv.begin(), csv.end(), '\n') == live + 1 &&
+                  csv.find("\n\"doe, \"\"jane\"\"\",5000\n") != string::npos;
+    for (int i = 1; result && i < 6000; i += 97) {
+        string line = "\n" + patientVector[i].getKey() + "," + to_string(patientVector[i].getSerial()) + "\n";
+        result = (csv.find(line) != string::npos) == (i % 4 != 0);
+    }
+
+    //filters select by serial range and by name
+    string jsonl;
+    options.format = EXPORTJSONL;
+    options.minSerial = 5000;
+    options.maxSerial = 5000;
+    stats = vaccineDatabase.exportPatients(bufferSink(jsonl), options);
+    result = result && stats.records == vaccineDatabase.countBySerial()[5000] &&
+             jsonl.find("{\"name\":\"doe, \\\"jane\\\"\",\"serial\":5000}\n") != string::npos;
+    string binary;
+    options.format = EXPORTBINARY;
+    options.minSerial = INT_MIN;
+    options.maxSerial = INT_MAX;
+    options.name = patientVector[1].getKey();
+    stats = vaccineDatabase.exportPatients(bufferSink(binary), options);
+    string expected = string("VACDBEX1") + char(10) + patientVector[1].getKey();
+    int serial = patientVector[1].getSerial();
+    expected += char(0x80 | (serial & 0x7f));
+    expected += char(serial >> 7);
+    return result && stats.records == 1 && binary == expected;
+}
+
+bool Tester::testCombiner() {
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    //four slots for six threads, so two of them run their operations directly
+    VacDBCombiner combiner(vaccineDatabase, 4);
+    const int numThreads = 6, perThread = 400, numShared = 100;
+    Random randKeyObject(97, 122);
+    vector<Patient> shared;
+    vector<vector<Patient>> own(numThreads);
+    for (int i = 0; i < numShared; i++) {
+        shared.push_back(Patient(randKeyObject.getRandString(9), MINID + i, true));
+    }
+    for (int t = 0; t < numThreads; t++) {
+        for (int i = 0; i < perThread; i++) {
+            own[t].push_back(Patient(randKeyObject.getRandString(10), MINID + i, true));
+        }
+    }
+
+    //every thread inserts its own patients, looks them up and removes half of them, and all of
+    //them insert the shared patients, which must succeed exactly once each; no thread exits
+    //before all are done, so the threads holding the four slots keep them throughout
+    atomic<int> sharedInserted(0), errors(0), finished(0);
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            auto waitForAll = [&]() {
+                finished++;
+                while (finished < numThreads) {
+                    this_thread::yield();
+                }
+            };
+            for (int i = 0; i < perThread; i++) {
+                if (!combiner.insert(own[t][i])) errors++;
+                if (i < numShared && combiner.insert(shared[i])) sharedInserted++;
+            }
+            for (int i = 0; i < perThread; i++) {
+                Patient found = combiner.getPatient(own[t][i].getKey(), own[t][i].getSerial());
+                if (!(found == own[t][i])) errors++;
+                if (i % 2 == 0) {
+                    future<CombinerResult> removed = combiner.submit({COMBINEREMOVE, own[t][i]});
+                    if (!removed.get().success) errors++;
+                }
+            }
+            waitForAll();
+        });
+    }
+    for (thread &worker: threads) {
+        worker.join();
+    }
+
+    //exited threads gave their slots back, so threads started later combine instead of locking
+    long direct = combiner.getStats().direct;
+    for (int t = 0; t < 10; t++) {
+        thread later([&]() {
+            if (!(combiner.getPatient(shared[0].getKey(), shared[0].getSerial()) == shared[0])) errors++;
+        });
+        later.join();
+    }
+
+    bool result = errors == 0 && sharedInserted == numShared;
+    for (int t = 0; result && t < numThreads; t++) {
+        for (int i = 0; result && i < perThread; i++) {
+            Patient found = vaccineDatabase.getPatient(own[t][i].getKey(), own[t][i].getSerial());
+            result = i % 2 == 0 ? found.getKey().empty() : found == own[t][i];
+        }
+    }
+
+    //within one batch a repeated lookup is answered from the first, and a duplicate insert is refused
+    Patient patient = own[0][1];
+    combiner.m_slots[0].m_request = {COMBINEGET, patient};
+    combiner.m_slots[1].m_request = {COMBINEINSERT, patient};
+    combiner.m_slots[2].m_request = {COMBINEGET, patient};
+    for (int i = 0; i < 3; i++) {
+        combiner.m_slots[i].m_state = VacDBCombiner::SLOTPENDING;
+    }
+    CombinerStats before = combiner.getStats();
+    combiner.tryCombine();
+    CombinerStats stats = combiner.getStats();
+    for (int i = 0; i < 3; i++) {
+        result = result && combiner.m_slots[i].m_state == VacDBCombiner::SLOTDONE;
+        combiner.m_slots[i].m_state = VacDBCombiner::SLOTEMPTY;
+    }
+    return result && combiner.m_slots[0].m_result.patient == patient && !combiner.m_slots[1].m_result.success &&
+           combiner.m_slots[2].m_result.success && stats.coalesced - before.coalesced == 2 &&
+           stats.batches - before.batches == 1 && direct > 0 && stats.direct == direct &&
+           vaccineDatabase.numPatients() == numShared + numThreads * perThread / 2;
+}
+
+bool Tester::testThrowingCombiner() {
+    //a hash function that throws leaves neither the combiner nor the table locked
+    VacDB vaccineDatabase(MINPRIME, throwingHash, QUADRATIC);
+    VacDBCombiner combiner(vaccineDatabase, 4);
+    bool threw = false;
+    try {
+        combiner.insert(Patient("throw", MINID, true));
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    return threw && !combiner.m_combining && !vaccineDatabase.m_batching && combiner.insert(Patient("Ymir", MINID, true));
+}
+
+bool Tester::testReplication() {
+    const string path = "/tmp/vacdb_mytest_replication.sock";
+    VacDB primaryDatabase(MINPRIME, hashFunction, QUADRATIC);
+    vector<Patient> patientVector = insertMultiplePatients(primaryDatabase, 3000);
+    ReplicationPrimary primary(primaryDatabase, 64);
+    VacDB replicaDatabase(MINPRIME, hashFunction, LINEAR);
+    ReplicationReplica replica(replicaDatabase);
+    bool result = primary.listenUnix(path) && replica.connectUnix(path);
+
+    //both ends are driven from this thread until the replica has caught up
+    auto catchUp = [&]() {
+        for (int round = 0; round < 1000; round++) {
+            primary.poll(0);
+            if (!replica.poll(1)) {
+                return false;
+            }
+            if (replica.getStats().snapshotLoaded && replica.appliedSequence() == primary.getStats().sequence) {
+                primary.poll(1);
+                return true;
+            }
+        }
+        return false;
+    };
+    result = result && catchUp() && replicaDatabase.numPatients() == primaryDatabase.numPatients();
+
+    //changes after the snapshot arrive as batched deltas
+    vector<Patient> morePatients = insertMultiplePatients(primaryDatabase, 2000);
+    for (int i = 0; i < 500; i++) {
+        primaryDatabase.remove(patientVector[i]);
+    }
+    for (int i = 0; i < 100; i++) {
+        Patient patient = morePatients[i];
+        int newSerial = patient.getSerial() == MAXID ? MINID : patient.getSerial() + 1;
+        primaryDatabase.updateSerialNumber(patient, newSerial);
+    }
+    //names are not cut to a byte's length
+    Patient longName(string(300, 'q'), MINID, true);
+    result = result && primaryDatabase.insert(longName) && catchUp() &&
+             replicaDatabase.getPatient(longName.getKey(), longName.getSerial()) == longName;
+
+    //the replica holds exactly the patients of the primary
+    map<string, int> primaryNames = primaryDatabase.countByName();
+    map<int, int> primarySerials = primaryDatabase.countBySerial();
+    result = result && replicaDatabase.countByName() == primaryNames && replicaDatabase.countBySerial() == primarySerials;
+    for (auto it = primaryDatabase.begin(); result && it != primaryDatabase.end(); ++it) {
+        result = replicaDatabase.getPatient(it->getKey(), it->getSerial()) == *it;
+    }
+
+    //a frame with a bad record after a good one applies neither
+    auto putInt = [](string &out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            out += char(value >> (8 * i));
+        }
+    };
+    string records = string(1, char(CHANGEINSERT)) + char(4) + "Ymir" + char(2 * 1234 % 128 + 128) +
+                     char(2 * 1234 / 128) + char(7);
+    string frame;
+    putInt(frame, 1 + 8 + 8 + 4 + records.size(), 4);
+    putInt(frame, FRAMECHANGES, 1);
+    putInt(frame, primary.getStats().sequence + 2, 8);
+    putInt(frame, 0, 8);
+    putInt(frame, 2, 4);
+    frame += records;
+    long before = replicaDatabase.numPatients();
+    result = result && replica.applyFrame(frame.data(), frame.size()) == -1 &&
+             replicaDatabase.numPatients() == before && replicaDatabase.getPatient("Ymir", 1234).getKey().empty();
+
+    PrimaryStats primaryStats = primary.getStats();
+    ReplicaStats replicaStats = replica.getStats();
+    result = result && primaryStats.replicas == 1 && primaryStats.snapshots == 1 && primaryStats.dropped == 0 &&
+           primaryStats.minAcked == primaryStats.sequence && primaryStats.frames > 1 &&
+           replicaStats.bulkPlaced >= 3000 && replicaStats.frames > primaryStats.frames &&
+           replicaStats.maxLagMicros >= replicaStats.meanLagMicros && replicaStats.meanLagMicros > 0;
+    return result;
+}
+
+bool Tester::testReplicationBacklog() {
+    //a replica that never reads is dropped once its backlog passes the limit
+    const string path = "/tmp/vacdb_mytest_backlog.sock";
+    VacDB primaryDatabase(MINPRIME, stringHash, QUADRATIC);
+    ReplicationPrimary primary(primaryDatabase, 64, 4096);
+    VacDB stalledDatabase(MINPRIME, stringHash, QUADRATIC);
+    ReplicationReplica stalled(stalledDatabase);
+    bool result = primary.listenUnix(path) && stalled.connectUnix(path);
+    primary.poll(10);
+    result = result && primary.getStats().replicas == 1;
+    insertMultiplePatients(primaryDatabase, 50000);
+    primary.flush();
+    PrimaryStats stats = primary.getStats();
+    result = result && stats.replicas == 0 && stats.dropped == 1;
+
+    //reconnecting with an empty table starts over from a snapshot
+    VacDB replicaDatabase(MINPRIME, stringHash, QUADRATIC);
+    ReplicationReplica replica(replicaDatabase);
+    result = result && replica.connectUnix(path);
+    for (int round = 0; result && round < 1000 && replicaDatabase.numPatients() < primaryDatabase.numPatients(); round++) {
+        primary.poll(0);
+        result = replica.poll(1);
+    }
+    stats = primary.getStats();
+    return result && replicaDatabase.numPatients() == primaryDatabase.numPatients() && stats.snapshots == 2 &&
+           stats.dropped == 1;
+}
+
+bool Tester::testReplicationFrameSize() {
+    //long names fill a frame long before the record count does, snapshots and batches are cut by size
+    const string path = "/tmp/vacdb_mytest_framesize.sock";
+    const int numPatients = 200;
+    const size_t nameLength = 100000;
+    VacDB primaryDatabase(MINPRIME, stringHash, QUADRATIC);
+    for (int i = 0; i < numPatients; i++) {
+        primaryDatabase.insert(Patient(string(nameLength, char('a' + i % 26)) + to_string(i), MINID + i, true));
+    }
+    ReplicationPrimary primary(primaryDatabase, 1000);
+    VacDB replicaDatabase(MINPRIME, stringHash, QUADRATIC);
+    ReplicationReplica replica(replicaDatabase);
+    bool result = primary.listenUnix(path) && replica.connectUnix(path);
+    auto catchUp = [&]() {
+        for (int round = 0; round < 1000; round++) {
+            primary.poll(0);
+            if (!replica.poll(1)) {
+                return false;
+            }
+            if (replicaDatabase.numPatients() == primaryDatabase.numPatients() &&
+                replica.appliedSequence() == primary.getStats().sequence) {
+                return true;
+            }
+        }
+        return false;
+    };
+    result = result && catchUp() && replica.getStats().frames > 1;
+    for (int i = 0; i < numPatients; i++) {
+        primaryDatabase.insert(Patient(string(nameLength, char('A' + i % 26)) + to_string(i), MINID + i, true));
+    }
+    long snapshotFrames = replica.getStats().frames;
+    result = result && catchUp() && primary.getStats().frames > 1 && replica.getStats().frames > snapshotFrames + 1;
+
+    //a record no frame can hold drops the replicas, and a new replica is refused while the table holds it
+    Patient oversized(string(1 << 24, 'z'), MINID, true);
+    result = result && primaryDatabase.insert(oversized);
+    primary.poll(0);
+    PrimaryStats stats = primary.getStats();
+    result = result && stats.replicas == 0 && stats.oversized == 1 && !replica.poll(10);
+    VacDB lateDatabase(MINPRIME, stringHash, QUADRATIC);
+    ReplicationReplica late(lateDatabase);
+    result = result && late.connectUnix(path);
+    primary.poll(10);
+    stats = primary.getStats();
+    return result && stats.replicas == 0 && stats.oversized == 2 && stats.dropped == 0 && lateDatabase.numPatients() == 0;
+}
+
+bool Tester::testProbeChainGuard() {
+    //a hash function that spreads the names never sets off the guard
+    //(hashFunction does not: its double sum overflows the int for names of ten letters)
+    VacDB ordinaryDatabase(MINPRIME, stringHash, LINEAR);
+    insertMultiplePatients(ordinaryDatabase, 3000);
+    VacDBStats ordinaryStats = ordinaryDatabase.getStats();
+    bool result = ordinaryStats.chainAlarms == 0 && ordinaryStats.hashSeed == 0;
+
+    //every name has the same home slot, so without the guard each insert walks past all earlier patients
+    VacDB vaccineDatabase(MINPRIME, collidingHash, QUADRATIC);
+    vector<Patient> patientVector;
+    for (int i = 0; i < 2000; i++) {
+        Patient patient("patient" + to_string(i), MINID + i % (MAXID - MINID + 1), true);
+        result = result && vaccineDatabase.insert(patient);
+        patientVector.push_back(patient);
+    }
+    for (int i = 0; i < 500; i++) {
+        result = result && vaccineDatabase.remove(patientVector[i]);
+    }
+    VacDBStats stats = vaccineDatabase.getStats();
+    result = result && stats.chainAlarms > 0 && stats.reseeds > 0 && stats.hashSeed != 0 &&
+             stats.longestChain <= stats.chainLimit && vaccineDatabase.numPatients() == 1500 &&
+             vaccineDatabase.m_currMaxProbe == stats.longestChain;
+    for (int i = 0; i < 2000; i++) {
+        Patient found = vaccineDatabase.getPatient(patientVector[i].getKey(), patientVector[i].getSerial());
+        result = result && (i < 500 ? found.getKey().empty() : found == patientVector[i]);
+    }
+
+    //the seed travels with a checkpoint, and concurrent readers hash with it as well
+    VacDB restored(MINPRIME, collidingHash, QUADRATIC);
+    result = result && vaccineDatabase.startCheckpoint("mytest_chains.bin") &&
+             vaccineDatabase.finishCheckpoint().success && restored.loadCheckpoint("mytest_chains.bin");
+    std::remove("mytest_chains.bin");
+    restored.enableConcurrentReaders();
+    result = result && restored.getStats().hashSeed == stats.hashSeed;
+    for (int i = 500; i < 2000; i++) {
+        result = result && restored.getPatient(patientVector[i].getKey(), patientVector[i].getSerial()) == patientVector[i];
+    }
+    result = result && restored.getPatient("patient0", MINID).getKey().empty();
+
+    //seeds are random unless a replay asks for the fixed sequence
+    VacDB first(MINPRIME, collidingHash, QUADRATIC), second(MINPRIME, collidingHash, QUADRATIC);
+    first.setDeterministicSeeds(true);
+    second.setDeterministicSeeds(true);
+    for (int i = 0; i < 300; i++) {
+        first.insert(patientVector[i]);
+        second.insert(patientVector[i]);
+    }
+    result = result && first.m_hashSeed != 0 && first.m_hashSeed == second.m_hashSeed &&
+             vaccineDatabase.m_hashSeed != first.m_hashSeed && vaccineDatabase.m_chainSlack == CHAINSLACK;
+
+    //without room for a second table no rebuild can help: the guard raises its limit once and rests,
+    //instead of trying again at every insert
+    VacDB budgetDatabase(MINPRIME, collidingHash, QUADRATIC);
+    ResizePolicy policy;
+    policy.maxBytes = budgetDatabase.footprint() + 60 * sizeof(Patient);
+    budgetDatabase.setResizePolicy(policy);
+    int numInserted = 0;
+    for (int i = 0; i < 200; i++) {
+        numInserted += budgetDatabase.insert(patientVector[i]);
+    }
+    stats = budgetDatabase.getStats();
+    result = result && numInserted > 0 && stats.reseeds == 0 && stats.guardGrowths == 0 &&
+             stats.chainLimitRaises == 1 && budgetDatabase.m_guardGaveUp && budgetDatabase.footprint() <= policy.maxBytes;
+
+    //once the table can grow again, the next table wakes the guard up and it reseeds as usual
+    budgetDatabase.setResizePolicy(ResizePolicy());
+    for (int i = 200; i < 2000; i++) {
+        budgetDatabase.insert(patientVector[i]);
+    }
+    stats = budgetDatabase.getStats();
+    return result && stats.reseeds > 0 && stats.longestChain <= stats.chainLimit &&
+           budgetDatabase.m_chainSlack == CHAINSLACK && budgetDatabase.numPatients() == numInserted + 1800;
+}
+
+bool Tester::testLongQuadraticWalk() {
+    //every slot but one holds a live patient, so the walk may run up to MAXPRIME steps
+    VacDB vaccineDatabase(MINPRIME, hashFunction, QUADRATIC);
+    Patient live("Ymir", MINID, true);
+    vector<Patient *> table(MAXPRIME, &live);
+    const unsigned int freeSlot = 12345, hash = 7;
+    table[freeSlot] = nullptr;
+
+    //the same walk with the squares summed in 64 bits
+    uint64_t index = hash % MAXPRIME;
+    int steps = 0;
+    for (uint64_t i = 1; i <= uint64_t(MAXPRIME) && index != freeSlot; i++) {
+        index = (index + i * i) % MAXPRIME;
+        steps++;
+    }
+    int probeLength = 0;
+    unsigned int found = vaccineDatabase.findFreeSlot(hash, table.data(), MAXPRIME, QUADRATIC, &probeLength);
+    return found == index && probeLength == steps && steps > 46340;
+}
 
 int main() {
     Tester tester;
@@ -485,6 +1710,172 @@ int main() {
         cout << "\t***Test failed!***" << endl;
     }
 
+    cout << "\nTesting iteration (during rehash):" << endl;
+    if (tester.testIteratorDuringRehash()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+    cout << "Testing parallel reports:" << endl;
+    if (tester.testParallelReports()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting resize policy (grow and shrink thresholds):" << endl;
+    if (tester.testResizePolicy()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+    cout << "Testing reserve and memory budget:" << endl;
+    if (tester.testReserveAndMemoryBudget()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting lock-free readers (during rehash):" << endl;
+    if (tester.testConcurrentReaders()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting lookup routing (during rehash):" << endl;
+    if (tester.testMigrationRouting()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting negative-lookup filter:" << endl;
+    if (tester.testNegativeFilter()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting checkpoint (during writes and rehash):" << endl;
+    if (tester.testCheckpointDuringWrites()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting checkpoint validation (damaged files are rejected):" << endl;
+    if (tester.testCheckpointValidation()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting server (pipelined and batched requests):" << endl;
+    if (tester.testServerPipelining()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting workload (trace record and replay):" << endl;
+    if (tester.testWorkloadTrace()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting adaptive probing (policy chosen at rehash):" << endl;
+    if (tester.testAdaptiveProbing()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting shared memory (reader process during rehashes):" << endl;
+    if (tester.testSharedMemory()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting rehashNow (parallel rebuild after bulk delete):" << endl;
+    if (tester.testRehashNow()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting tiered storage (demotion to a cold segment):" << endl;
+    if (tester.testTieredStorage()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting aggregates (live totals, name and serial counts):" << endl;
+    if (tester.testAggregates()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting exportPatients (CSV, JSON lines, binary, filters):" << endl;
+    if (tester.testExport()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting VacDBCombiner (flat combining from many threads):" << endl;
+    if (tester.testCombiner()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting VacDBCombiner with a throwing hash (no combiner or table lock left held):" << endl;
+    if (tester.testThrowingCombiner()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting replication (snapshot and change stream to a replica):" << endl;
+    if (tester.testReplication()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting replication backlog limit (stalled replica dropped, reconnect from a snapshot):" << endl;
+    if (tester.testReplicationBacklog()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting replication frames cut by size (long names, oversized record):" << endl;
+    if (tester.testReplicationFrameSize()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting the probe-chain guard (reseeded rehash against colliding names):" << endl;
+    if (tester.testProbeChainGuard()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
+    cout << "\nTesting a quadratic walk over a nearly full table of MAXPRIME slots:" << endl;
+    if (tester.testLongQuadraticWalk()) {
+        cout << "\tTest passed!" << endl;
+    } else {
+        cout << "\t***Test failed!***" << endl;
+    }
+
     return 0;
 }
 
@@ -496,4 +1887,23 @@ unsigned int hashFunction(string id) {
         result += id[i] * pow(prime, i);
     }
     return result;
-}
\ No newline at end of file
+}
+
+unsigned int throwingHash(string str) {
+    if (str == "throw") {
+        throw runtime_error("hash of \"throw\"");
+    }
+    return stringHash(str);
+}
+
+unsigned int collidingHash(string) {
+    //the worst case: every name collides
+    return 42;
+}
+
+unsigned int stringHash(string str) {
+    unsigned int val = 0;
+    for (unsigned int i = 0; i < str.length(); i++)
+        val = val * 33 + str[i];
+    return val;
+}
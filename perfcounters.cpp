@@ -0,0 +1,89 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "perfcounters.h"
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static uint64_t cacheConfig(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+static int openCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    //this thread only, on whichever cpu it runs
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+PerfCounters::PerfCounters() : m_numOpen(0) {
+    const uint32_t types[NUMCOUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+                                         PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+    const uint64_t configs[NUMCOUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),
+            cacheConfig(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),
+            PERF_COUNT_HW_BRANCH_MISSES,
+            cacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)};
+    for (int i = 0; i < NUMCOUNTERS; i++) {
+        m_fds[i] = openCounter(types[i], configs[i]);
+        m_values[i] = -1;
+        if (m_fds[i] >= 0) {
+            m_numOpen++;
+        } else if (m_error.empty()) {
+            m_error = string(name(counter_t(i))) + ": " + strerror(errno);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd: m_fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void PerfCounters::start() {
+    for (int fd: m_fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (int fd: m_fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int i = 0; i < NUMCOUNTERS; i++) {
+        //value, time enabled, time running
+        uint64_t reading[3];
+        if (m_fds[i] < 0 || read(m_fds[i], reading, sizeof(reading)) != sizeof(reading)) {
+            m_values[i] = -1;
+        } else if (reading[2] == 0) {
+            //never scheduled on the pmu
+            m_values[i] = reading[1] == 0 ? 0 : -1;
+        } else {
+            m_values[i] = double(reading[0]) * double(reading[1]) / double(reading[2]);
+        }
+    }
+}
+
+const char *PerfCounters::name(counter_t counter) {
+    static const char *names[NUMCOUNTERS] = {"cycles", "instr", "L1d-miss", "LLC-miss", "br-miss", "dTLB-miss"};
+    return names[counter];
+}
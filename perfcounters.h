@@ -0,0 +1,36 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+#include <cstdint>
+#include <string>
+using namespace std;
+// Linux hardware counters for the calling thread, read through perf_event_open(2).
+// Every counter is opened on its own, so a CPU or container that lacks some of
+// them (or all, e.g. perf_event_paranoid > 2 or a VM without a PMU) still gets
+// the others; unavailable counters read as -1.
+enum counter_t {CYCLES, INSTRUCTIONS, L1DMISSES, LLCMISSES, BRANCHMISSES, DTLBMISSES, NUMCOUNTERS};
+
+class PerfCounters{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    // true if at least one counter could be opened
+    bool available() const {return m_numOpen > 0;}
+    bool available(counter_t counter) const {return m_fds[counter] >= 0;}
+    // errno text of the first counter that failed to open, empty if all opened
+    const string& error() const {return m_error;}
+    void start();
+    void stop();
+    // count between the last start() and stop(), scaled up if the kernel had to
+    // multiplex the counters; -1 if the counter is unavailable
+    double value(counter_t counter) const {return m_values[counter];}
+    static const char* name(counter_t counter);
+private:
+    int    m_fds[NUMCOUNTERS];
+    double m_values[NUMCOUNTERS];
+    int    m_numOpen;
+    string m_error;
+};
+#endif
@@ -0,0 +1,179 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "protocol.h"
+#include <cstring>
+
+// appends little-endian integers and names to a frame
+class FrameWriter{
+public:
+    explicit FrameWriter(string &out) : m_out(out), m_start(out.size()), m_ok(true) {putInt(0, 4);}
+    void putInt(uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            m_out.push_back(char(value >> (8 * i)));
+        }
+    }
+    // a name longer than the uint16 length field fails the frame
+    void putName(const string &name) {
+        if (name.size() > 0xFFFF) {
+            m_ok = false;
+            return;
+        }
+        putInt(name.size(), 2);
+        m_out.append(name);
+    }
+    // writes the frame length into the placeholder; a failed or oversized
+    // frame is removed from the output again and false is returned
+    bool finish() {
+        size_t length = m_out.size() - m_start - 4;
+        if (!m_ok || length > MAXFRAME) {
+            m_out.resize(m_start);
+            return false;
+        }
+        for (int i = 0; i < 4; i++) {
+            m_out[m_start + i] = char(length >> (8 * i));
+        }
+        return true;
+    }
+private:
+    string &m_out;
+    size_t m_start;
+    bool m_ok;
+};
+
+// reads a frame, every read past the end of the frame sets the error flag
+class FrameReader{
+public:
+    FrameReader(const char *data, size_t size) : m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+    uint32_t getInt(int bytes) {
+        if (m_pos + bytes > m_size) {
+            m_ok = false;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value |= uint32_t(uint8_t(m_data[m_pos + i])) << (8 * i);
+        }
+        m_pos += bytes;
+        return value;
+    }
+    string getName() {
+        uint32_t length = getInt(2);
+        if (m_pos + length > m_size) {
+            m_ok = false;
+            return "";
+        }
+        string name(m_data + m_pos, length);
+        m_pos += length;
+        return name;
+    }
+    bool ok() const {return m_ok;}
+    bool atEnd() const {return m_pos == m_size;}
+private:
+    const char *m_data;
+    size_t m_size;
+    size_t m_pos;
+    bool m_ok;
+};
+
+// length of the frame at the start of data: 0 if incomplete, -1 if malformed;
+// a prefix below the smallest possible frame is malformed right away, since
+// waiting for more bytes could never complete it
+static long frameLength(const char *data, size_t size, uint32_t minimum) {
+    if (size < 4) {
+        return 0;
+    }
+    uint32_t length = FrameReader(data, 4).getInt(4);
+    if (length < minimum || length > MAXFRAME) {
+        return -1;
+    }
+    return size < 4 + size_t(length) ? 0 : long(length);
+}
+
+bool returnsPatients(op_t op) {
+    return op == OP_GET || op == OP_BATCHGET;
+}
+
+bool encodeRequest(const Request &request, string &out) {
+    FrameWriter frame(out);
+    frame.putInt(request.op, 1);
+    frame.putInt(request.id, 4);
+    if (request.op == OP_UPDATE) {
+        frame.putInt(request.newSerial, 4);
+    }
+    frame.putInt(request.patients.size(), 4);
+    for (const Patient &patient: request.patients) {
+        frame.putName(patient.getKey());
+        frame.putInt(patient.getSerial(), 4);
+    }
+    return frame.finish();
+}
+
+bool encodeResponse(op_t op, const Response &response, string &out) {
+    FrameWriter frame(out);
+    frame.putInt(response.id, 4);
+    frame.putInt(response.statuses.size(), 4);
+    for (uint8_t status: response.statuses) {
+        frame.putInt(status, 1);
+    }
+    if (returnsPatients(op)) {
+        for (const Patient &patient: response.patients) {
+            frame.putName(patient.getKey());
+            frame.putInt(patient.getSerial(), 4);
+        }
+    }
+    return frame.finish();
+}
+
+long decodeRequest(const char *data, size_t size, Request &request) {
+    //op, id and count
+    long length = frameLength(data, size, 9);
+    if (length <= 0) {
+        return length;
+    }
+    FrameReader frame(data + 4, length);
+    request.op = op_t(frame.getInt(1));
+    request.id = frame.getInt(4);
+    if (request.op < OP_INSERT || request.op > OP_BATCHGET) {
+        return -1;
+    }
+    request.newSerial = request.op == OP_UPDATE ? int(frame.getInt(4)) : 0;
+    uint32_t count = frame.getInt(4);
+    //every patient needs at least 6 bytes, which bounds count before reserving
+    if (!frame.ok() || count > uint32_t(length) / 6) {
+        return -1;
+    }
+    request.patients.clear();
+    request.patients.reserve(count);
+    for (uint32_t i = 0; i < count && frame.ok(); i++) {
+        string name = frame.getName();
+        int serial = int(frame.getInt(4));
+        request.patients.push_back(Patient(name, serial, true));
+    }
+    return frame.ok() && frame.atEnd() ? 4 + length : -1;
+}
+
+long decodeResponse(op_t op, const char *data, size_t size, Response &response) {
+    //id and count
+    long length = frameLength(data, size, 8);
+    if (length <= 0) {
+        return length;
+    }
+    FrameReader frame(data + 4, length);
+    response.id = frame.getInt(4);
+    uint32_t count = frame.getInt(4);
+    if (!frame.ok() || count > uint32_t(length)) {
+        return -1;
+    }
+    response.statuses.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        response.statuses[i] = frame.getInt(1);
+    }
+    response.patients.clear();
+    if (returnsPatients(op)) {
+        for (uint32_t i = 0; i < count && frame.ok(); i++) {
+            string name = frame.getName();
+            int serial = int(frame.getInt(4));
+            response.patients.push_back(Patient(name, serial, !name.empty()));
+        }
+    }
+    return frame.ok() && frame.atEnd() ? 4 + length : -1;
+}
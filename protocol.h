@@ -0,0 +1,43 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vacdb.h"
+using namespace std;
+// Binary protocol of the VacDB server. Every frame starts with its length
+// (uint32, not counting the length itself), integers are little-endian and
+// names are sent as uint16 length + bytes.
+//   request:  length, uint8 op, uint32 id, [int32 new serial for OP_UPDATE],
+//             uint32 count, count * (name, int32 serial)
+//   response: length, uint32 id, uint32 count, count * uint8 status,
+//             and for OP_GET/OP_BATCHGET count * (name, int32 serial)
+// Single operations carry one patient; batch operations any number.
+// A client may send any number of requests before reading the responses
+// (pipelining); responses of a connection come back in request order.
+enum op_t : uint8_t {OP_INSERT = 1, OP_REMOVE, OP_GET, OP_UPDATE, OP_BATCHINSERT, OP_BATCHREMOVE, OP_BATCHGET};
+const uint32_t MAXFRAME = 1 << 24;  // larger frames are treated as malformed
+
+struct Request{
+    op_t op = OP_GET;
+    uint32_t id = 0;
+    int newSerial = 0;              // only used by OP_UPDATE
+    vector<Patient> patients;
+};
+struct Response{
+    uint32_t id = 0;
+    vector<uint8_t> statuses;       // 1 if the operation on the patient succeeded
+    vector<Patient> patients;       // found patients of OP_GET/OP_BATCHGET (empty name if not found)
+};
+
+bool returnsPatients(op_t op);
+// append one frame to out; false (and out unchanged) if a name is longer
+// than 0xFFFF bytes or the frame would exceed MAXFRAME
+bool encodeRequest(const Request& request, string& out);
+bool encodeResponse(op_t op, const Response& response, string& out);
+// decode the frame at the start of data: returns the number of bytes used,
+// 0 if the frame is not complete yet and -1 if it is malformed
+long decodeRequest(const char* data, size_t size, Request& request);
+long decodeResponse(op_t op, const char* data, size_t size, Response& response);
+#endif
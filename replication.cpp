@@ -0,0 +1,513 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "replication.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t FRAMEHEADER = 4 + 1 + 8 + 8 + 4;
+static const uint32_t MAXREPLICATIONFRAME = 1 << 24;  // larger frames are treated as malformed
+static const size_t MAXFRAMERECORDS = MAXREPLICATIONFRAME - (FRAMEHEADER - 4);  // record bytes one frame holds
+static const uint32_t SNAPSHOTRECORDS = 4096;         // records per snapshot frame
+
+// steady_clock is CLOCK_MONOTONIC on Linux, so both ends of a local stream share it
+static int64_t monotonicMicros() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void putVarint(string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+static bool getVarint(const char *&data, const char *end, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        uint8_t byte = uint8_t(*data++);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t zigzag(int value) {
+    return (uint64_t(uint32_t(value)) << 1) ^ uint64_t(int64_t(value >> 31));
+}
+
+static int unzigzag(uint64_t value) {
+    return int(uint32_t(value >> 1) ^ -uint32_t(value & 1));
+}
+
+template <typename T>
+static void putFixed(string &out, T value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+static T getFixed(const char *data) {
+    T value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void putRecord(string &out, change_t change, const string &name, int serial, int newSerial) {
+    out += char(change);
+    putVarint(out, name.size());
+    out += name;
+    putVarint(out, zigzag(serial));
+    if (change == CHANGEUPDATE) {
+        putVarint(out, zigzag(newSerial));
+    }
+}
+
+static void putFrame(string &out, frame_t kind, uint64_t sequence, int64_t oldest, uint32_t count,
+                     const string &records) {
+    putFixed<uint32_t>(out, uint32_t(FRAMEHEADER - 4 + records.size()));
+    out += char(kind);
+    putFixed<uint64_t>(out, sequence);
+    putFixed<int64_t>(out, oldest);
+    putFixed<uint32_t>(out, count);
+    out += records;
+}
+
+ReplicationPrimary::ReplicationPrimary(VacDB &vacdb, int batchRecords, size_t maxBacklogBytes)
+    : m_vacdb(vacdb), m_batchRecords(max(1, batchRecords)), m_maxBacklogBytes(maxBacklogBytes), m_pendingCount(0),
+      m_pendingOldest(0) {
+    m_vacdb.setChangeListener(this);
+}
+
+ReplicationPrimary::~ReplicationPrimary() {
+    flush();
+    m_vacdb.setChangeListener(nullptr);
+    for (Replica &replica: m_replicas) {
+        close(replica.m_fd);
+    }
+    for (int fd: m_listenFds) {
+        close(fd);
+    }
+    if (!m_unixPath.empty()) {
+        unlink(m_unixPath.c_str());
+    }
+}
+
+bool ReplicationPrimary::listenUnix(const string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 16) != 0) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    m_unixPath = path;
+    m_listenFds.push_back(fd);
+    return true;
+}
+
+bool ReplicationPrimary::listenTcp(int port) {
+    //replicas run on the same machine
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 16) != 0) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    m_listenFds.push_back(fd);
+    return true;
+}
+
+void ReplicationPrimary::changed(change_t change, const Patient &patient, int newSerial) {
+    m_record.clear();
+    putRecord(m_record, change, patient.getKey(), patient.getSerial(), newSerial);
+    //the pending batch is closed before the record would push its frame over the limit
+    if (m_pendingCount > 0 && m_pending.size() + m_record.size() > MAXFRAMERECORDS) {
+        flush();
+    }
+    m_stats.sequence++;
+    if (m_record.size() > MAXFRAMERECORDS) {
+        //no frame can carry the change, so no connected replica can follow the primary any more
+        m_stats.oversized++;
+        dropReplicas();
+        return;
+    }
+    if (m_pendingCount == 0) {
+        m_pendingOldest = monotonicMicros();
+    }
+    m_pending += m_record;
+    m_pendingCount++;
+    if (m_pendingCount >= uint32_t(m_batchRecords)) {
+        flush();
+    }
+}
+
+void ReplicationPrimary::dropReplicas() {
+    for (Replica &replica: m_replicas) {
+        close(replica.m_fd);
+    }
+    m_replicas.clear();
+}
+
+void ReplicationPrimary::flush() {
+    if (m_pendingCount > 0) {
+        string frame;
+        putFrame(frame, FRAMECHANGES, m_stats.sequence, m_pendingOldest, m_pendingCount, m_pending);
+        for (Replica &replica: m_replicas) {
+            replica.m_out += frame;
+        }
+        m_stats.frames++;
+        m_stats.records += m_pendingCount;
+        m_pending.clear();
+        m_pendingCount = 0;
+    }
+
+    //a replica whose socket fails or that does not keep up is dropped, the others go on
+    for (size_t r = 0; r < m_replicas.size();) {
+        Replica &replica = m_replicas[r];
+        bool keep = writeReplica(replica);
+        if (keep && replica.m_out.size() - replica.m_outSent - replica.m_snapshotLeft > m_maxBacklogBytes) {
+            keep = false;
+            m_stats.dropped++;
+        }
+        if (keep) {
+            r++;
+        } else {
+            close(m_replicas[r].m_fd);
+            m_replicas.erase(m_replicas.begin() + r);
+        }
+    }
+}
+
+void ReplicationPrimary::poll(int timeoutMs) {
+    flush();
+    vector<pollfd> fds;
+    for (int fd: m_listenFds) {
+        fds.push_back({fd, POLLIN, 0});
+    }
+    for (Replica &replica: m_replicas) {
+        short events = POLLIN | (replica.m_outSent < replica.m_out.size() ? POLLOUT : 0);
+        fds.push_back({replica.m_fd, events, 0});
+    }
+    if (::poll(fds.data(), fds.size(), timeoutMs) <= 0) {
+        return;
+    }
+
+    size_t numListening = m_listenFds.size();
+    vector<bool> keep(m_replicas.size(), true);
+    for (size_t r = 0; r < m_replicas.size(); r++) {
+        short events = fds[numListening + r].revents;
+        if (events & (POLLIN | POLLHUP | POLLERR)) {
+            keep[r] = readReplica(m_replicas[r]);
+        }
+        if (keep[r] && (events & POLLOUT)) {
+            keep[r] = writeReplica(m_replicas[r]);
+        }
+    }
+    for (size_t r = m_replicas.size(); r-- > 0;) {
+        if (!keep[r]) {
+            close(m_replicas[r].m_fd);
+            m_replicas.erase(m_replicas.begin() + r);
+        }
+    }
+    for (size_t i = 0; i < numListening; i++) {
+        if (fds[i].revents & POLLIN) {
+            acceptReplicas(m_listenFds[i]);
+        }
+    }
+}
+
+void ReplicationPrimary::acceptReplicas(int listenFd) {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        //changes made so far go out to the other replicas first, the snapshot already contains them
+        flush();
+        Replica replica;
+        replica.m_fd = fd;
+        if (!sendSnapshot(replica)) {
+            m_stats.oversized++;
+            close(fd);
+        } else if (writeReplica(replica)) {
+            m_replicas.push_back(replica);
+        } else {
+            close(fd);
+        }
+    }
+}
+
+bool ReplicationPrimary::sendSnapshot(Replica &replica) {
+    int64_t now = monotonicMicros();
+    string records;
+    uint32_t count = 0;
+    bool fits = true;
+    //a frame is closed once it holds SNAPSHOTRECORDS records or the next one would push it over the limit
+    auto add = [&](const string &name, int serial) {
+        m_record.clear();
+        putRecord(m_record, CHANGEINSERT, name, serial, 0);
+        fits = fits && m_record.size() <= MAXFRAMERECORDS;
+        if (count > 0 && records.size() + m_record.size() > MAXFRAMERECORDS) {
+            putFrame(replica.m_out, FRAMESNAPSHOT, m_stats.sequence, now, count, records);
+            records.clear();
+            count = 0;
+        }
+        records += m_record;
+        if (++count == SNAPSHOTRECORDS) {
+            putFrame(replica.m_out, FRAMESNAPSHOT, m_stats.sequence, now, count, records);
+            records.clear();
+            count = 0;
+        }
+    };
+    for (auto it = m_vacdb.begin(); fits && it != m_vacdb.end(); ++it) {
+        add(it->getKey(), it->getSerial());
+    }
+    if (fits && m_vacdb.m_cold != nullptr) {
+        vector<ColdEntry> entries;
+        m_vacdb.m_cold->liveEntries(entries);
+        for (size_t i = 0; fits && i < entries.size(); i++) {
+            add(entries[i].name, entries[i].serial);
+        }
+    }
+    if (!fits) {
+        return false;
+    }
+    //an empty table still sends one frame, which tells the replica where the stream starts
+    if (count > 0 || replica.m_out.empty()) {
+        putFrame(replica.m_out, FRAMESNAPSHOT, m_stats.sequence, now, count, records);
+    }
+    replica.m_snapshotLeft = replica.m_out.size() - replica.m_outSent;
+    replica.m_acked = 0;
+    m_stats.snapshots++;
+    return true;
+}
+
+bool ReplicationPrimary::writeReplica(Replica &replica) {
+    while (replica.m_outSent < replica.m_out.size()) {
+        ssize_t sent = send(replica.m_fd, replica.m_out.data() + replica.m_outSent,
+                            replica.m_out.size() - replica.m_outSent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            replica.m_outSent += sent;
+            replica.m_snapshotLeft -= min(replica.m_snapshotLeft, size_t(sent));
+            m_stats.bytesSent += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    //the sent prefix is dropped once it dominates the buffer
+    if (replica.m_outSent == replica.m_out.size()) {
+        replica.m_out.clear();
+        replica.m_outSent = 0;
+    } else if (replica.m_outSent > replica.m_out.size() / 2) {
+        replica.m_out.erase(0, replica.m_outSent);
+        replica.m_outSent = 0;
+    }
+    return true;
+}
+
+bool ReplicationPrimary::readReplica(Replica &replica) {
+    char buffer[4096];
+    bool open = true;
+    while (true) {
+        ssize_t received = recv(replica.m_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received > 0) {
+            replica.m_in.append(buffer, received);
+        } else if (received == 0) {
+            open = false;
+            break;
+        } else if (errno != EINTR) {
+            open = errno == EAGAIN || errno == EWOULDBLOCK;
+            break;
+        }
+    }
+    //only the latest acknowledgement matters
+    size_t complete = replica.m_in.size() / sizeof(uint64_t) * sizeof(uint64_t);
+    if (complete > 0) {
+        replica.m_acked = getFixed<uint64_t>(replica.m_in.data() + complete - sizeof(uint64_t));
+        replica.m_in.erase(0, complete);
+    }
+    return open;
+}
+
+PrimaryStats ReplicationPrimary::getStats() const {
+    PrimaryStats stats = m_stats;
+    stats.replicas = int(m_replicas.size());
+    stats.minAcked = m_stats.sequence;
+    for (const Replica &replica: m_replicas) {
+        stats.minAcked = min(stats.minAcked, replica.m_acked);
+    }
+    return stats;
+}
+
+ReplicationReplica::ReplicationReplica(VacDB &vacdb)
+    : m_vacdb(vacdb), m_fd(-1), m_changeFrames(0), m_totalLagMicros(0) {}
+
+ReplicationReplica::~ReplicationReplica() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool ReplicationReplica::connectUnix(const string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return m_fd >= 0 && connect(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+}
+
+bool ReplicationReplica::connectTcp(int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    m_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int noDelay = 1;
+    return m_fd >= 0 && setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) == 0 &&
+           connect(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+}
+
+bool ReplicationReplica::poll(int timeoutMs) {
+    if (m_fd < 0) {
+        return false;
+    }
+    pollfd fd = {m_fd, POLLIN, 0};
+    bool open = true;
+    if (::poll(&fd, 1, timeoutMs) > 0) {
+        char buffer[1 << 16];
+        while (true) {
+            ssize_t received = recv(m_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (received > 0) {
+                m_in.append(buffer, received);
+            } else if (received == 0) {
+                open = false;
+                break;
+            } else if (errno != EINTR) {
+                open = errno == EAGAIN || errno == EWOULDBLOCK;
+                break;
+            }
+        }
+    }
+
+    size_t used = 0;
+    long length = 0;
+    while ((length = applyFrame(m_in.data() + used, m_in.size() - used)) > 0) {
+        used += length;
+    }
+    m_in.erase(0, used);
+    if (length < 0) {
+        return false;
+    }
+
+    //the primary learns how far this replica got once per poll
+    if (used > 0 && open) {
+        uint64_t applied = m_stats.appliedSequence;
+        open = send(m_fd, &applied, sizeof(applied), MSG_NOSIGNAL) == ssize_t(sizeof(applied));
+    }
+    return open;
+}
+
+long ReplicationReplica::applyFrame(const char *data, size_t size) {
+    if (size < FRAMEHEADER) {
+        return 0;
+    }
+    uint32_t length = getFixed<uint32_t>(data);
+    if (length < FRAMEHEADER - 4 || length > MAXREPLICATIONFRAME || uint8_t(data[4]) > FRAMECHANGES) {
+        return -1;
+    }
+    if (size < 4 + size_t(length)) {
+        return 0;
+    }
+    frame_t kind = frame_t(data[4]);
+    uint64_t sequence = getFixed<uint64_t>(data + 5);
+    int64_t oldest = getFixed<int64_t>(data + 13);
+    uint32_t count = getFixed<uint32_t>(data + 21);
+    const char *record = data + FRAMEHEADER;
+    const char *end = data + 4 + length;
+
+    //the whole frame is decoded first, a malformed record must not leave half of it applied
+    m_changes.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t nameLength = 0, serial = 0, newSerial = 0;
+        if (record == end || uint8_t(record[0]) > CHANGEUPDATE) {
+            return -1;
+        }
+        change_t change = change_t(*record++);
+        if (!getVarint(record, end, nameLength) || nameLength > uint64_t(end - record)) {
+            return -1;
+        }
+        string name(record, nameLength);
+        record += nameLength;
+        if (!getVarint(record, end, serial) || (change == CHANGEUPDATE && !getVarint(record, end, newSerial))) {
+            return -1;
+        }
+        m_changes.push_back({change, Patient(name, unzigzag(serial), true), unzigzag(newSerial)});
+    }
+    if (record != end) {
+        return -1;
+    }
+
+    //runs of inserts are placed together, the other changes in between keep their order
+    auto placeInserts = [this]() {
+        if (!m_inserts.empty()) {
+            m_stats.bulkPlaced += m_vacdb.insertBulk(m_inserts);
+            m_inserts.clear();
+        }
+    };
+    for (Change &change: m_changes) {
+        if (change.m_change == CHANGEINSERT) {
+            m_inserts.push_back(change.m_patient);
+            continue;
+        }
+        placeInserts();
+        if (change.m_change == CHANGEREMOVE) {
+            m_vacdb.remove(change.m_patient);
+        } else {
+            m_vacdb.updateSerialNumber(change.m_patient, change.m_newSerial);
+        }
+    }
+    placeInserts();
+
+    m_stats.appliedSequence = sequence;
+    m_stats.frames++;
+    m_stats.records += count;
+    if (kind == FRAMESNAPSHOT) {
+        m_stats.snapshotLoaded = true;
+    } else {
+        m_stats.lastLagMicros = double(monotonicMicros() - oldest);
+        m_stats.maxLagMicros = max(m_stats.maxLagMicros, m_stats.lastLagMicros);
+        m_totalLagMicros += m_stats.lastLagMicros;
+        m_stats.meanLagMicros = m_totalLagMicros / ++m_changeFrames;
+    }
+    return 4 + length;
+}
@@ -0,0 +1,140 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef REPLICATION_H
+#define REPLICATION_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vacdb.h"
+using namespace std;
+// Primary/replica change stream between processes on one machine.
+//
+// The primary listens on a Unix or loopback TCP socket. A replica that connects first
+// receives a snapshot of every live patient, then the changes of the primary VacDB as
+// they happen, batched into frames:
+//   uint32 length (not counting itself), uint8 kind (FRAMESNAPSHOT, FRAMECHANGES),
+//   uint64 sequence of the last change included, int64 monotonic clock microseconds
+//   of the oldest change in the frame, uint32 count, then count records:
+//   uint8 change_t, varint name length, name bytes, zigzag varint serial,
+//   and for CHANGEUPDATE a zigzag varint new serial.
+// A replica answers every frame it has applied with the uint64 sequence it reached.
+// Both ends are driven by the thread that owns their VacDB and never block it for long.
+// A replica that falls too far behind is dropped; it has to reconnect with an empty
+// VacDB and starts over from a new snapshot.
+enum frame_t : uint8_t {FRAMESNAPSHOT, FRAMECHANGES};
+
+struct PrimaryStats{
+    int      replicas = 0;          // connected
+    uint64_t sequence = 0;          // changes made since the primary was created
+    uint64_t minAcked = 0;          // lowest sequence applied by every connected replica
+    long     frames = 0;            // change frames closed (each is sent to every replica)
+    long     records = 0;
+    long     snapshots = 0;         // replicas given a snapshot
+    long     dropped = 0;           // replicas dropped for a backlog above maxBacklogBytes
+    long     oversized = 0;         // changes and snapshots refused for a record too large for any frame
+    size_t   bytesSent = 0;
+};
+
+struct ReplicaStats{
+    uint64_t appliedSequence = 0;
+    bool     snapshotLoaded = false;
+    long     frames = 0;
+    long     records = 0;
+    long     bulkPlaced = 0;        // inserts applied through VacDB::insertBulk()
+    // time from a change on the primary to the end of applying the frame holding it,
+    // measured for the oldest change of every frame
+    double   lastLagMicros = 0;
+    double   maxLagMicros = 0;
+    double   meanLagMicros = 0;
+};
+
+// Streams the changes of vacdb to any number of replicas. Changes are collected in the
+// calling thread and sent once batchRecords of them are pending, or by flush() and poll().
+// A replica with more than maxBacklogBytes of change frames its socket has not taken is
+// dropped (its snapshot does not count, its size follows from the table).
+// A batch is also closed before it would outgrow the largest frame a replica accepts. A
+// single record too large for any frame cannot be streamed: a change of that kind drops
+// every replica and a replica connecting while the table holds one is refused, both
+// counted in PrimaryStats::oversized.
+class ReplicationPrimary : public ChangeListener{
+public:
+    explicit ReplicationPrimary(VacDB& vacdb, int batchRecords = 256, size_t maxBacklogBytes = 1 << 26);
+    ~ReplicationPrimary();
+    ReplicationPrimary(const ReplicationPrimary&) = delete;
+    ReplicationPrimary& operator=(const ReplicationPrimary&) = delete;
+    bool listenUnix(const string& path);
+    bool listenTcp(int port);
+    // accepts new replicas, sends the pending changes and collects acknowledgements,
+    // waiting up to timeoutMs for one of them to happen
+    void poll(int timeoutMs = 0);
+    // closes the pending changes into a frame and sends what the sockets take
+    void flush();
+    PrimaryStats getStats() const;
+    void changed(change_t change, const Patient& patient, int newSerial) override;
+private:
+    struct Replica{
+        int      m_fd;
+        string   m_out;             // frames not yet written
+        size_t   m_outSent = 0;
+        size_t   m_snapshotLeft = 0; // bytes of the snapshot at the start of m_out not yet written
+        string   m_in;              // partial acknowledgement
+        uint64_t m_acked = 0;
+    };
+    void acceptReplicas(int listenFd);
+    // false if a record does not fit a frame
+    bool sendSnapshot(Replica& replica);
+    void dropReplicas();
+    // returns false when the replica has to be dropped
+    bool writeReplica(Replica& replica);
+    bool readReplica(Replica& replica);
+    void closeFrame(string& frame, frame_t kind, uint64_t sequence, int64_t oldest, uint32_t count);
+
+    VacDB&   m_vacdb;
+    int      m_batchRecords;
+    size_t   m_maxBacklogBytes;
+    vector<int> m_listenFds;
+    string   m_unixPath;            // removed again by the destructor
+    vector<Replica> m_replicas;
+    string   m_pending;             // encoded changes not yet in a frame
+    string   m_record;              // the record being encoded, reused
+    uint32_t m_pendingCount;
+    int64_t  m_pendingOldest;
+    PrimaryStats m_stats;
+};
+
+// Applies the change stream of a primary to vacdb, which should be empty when it connects.
+// Runs of inserts are placed with VacDB::insertBulk(), removes and updates one by one.
+// A frame is decoded completely before any of it is applied, so a malformed frame
+// changes nothing.
+class Tester;
+class ReplicationReplica{
+public:
+    friend class Tester;
+    explicit ReplicationReplica(VacDB& vacdb);
+    ~ReplicationReplica();
+    ReplicationReplica(const ReplicationReplica&) = delete;
+    ReplicationReplica& operator=(const ReplicationReplica&) = delete;
+    bool connectUnix(const string& path);
+    bool connectTcp(int port);
+    // applies every complete frame that has arrived, waiting up to timeoutMs for data;
+    // returns false once the stream is closed or malformed
+    bool poll(int timeoutMs = 0);
+    uint64_t appliedSequence() const {return m_stats.appliedSequence;}
+    ReplicaStats getStats() const {return m_stats;}
+private:
+    struct Change{
+        change_t m_change;
+        Patient  m_patient;
+        int      m_newSerial;
+    };
+    // applies the frame at the start of data, returns its size, 0 if incomplete and -1 if malformed
+    long applyFrame(const char* data, size_t size);
+    VacDB&  m_vacdb;
+    int     m_fd;
+    string  m_in;
+    vector<Change>  m_changes;      // the decoded records of the frame being applied, reused
+    vector<Patient> m_inserts;      // the current run of inserts, reused
+    ReplicaStats m_stats;
+    long    m_changeFrames;         // frames the lag is averaged over (snapshots are not)
+    double  m_totalLagMicros;
+};
+#endif
@@ -0,0 +1,309 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+VacDBServer::VacDBServer(VacDB &vacdb) : m_vacdb(vacdb), m_stopping(false), m_requestsServed(0) {
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd >= 0 && m_wakeFd >= 0) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = m_wakeFd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+    }
+}
+
+VacDBServer::~VacDBServer() {
+    stopRecording();
+    for (auto &connection: m_connections) {
+        close(connection.first);
+    }
+    for (int fd: m_listenFds) {
+        close(fd);
+    }
+    if (!m_unixPath.empty()) {
+        unlink(m_unixPath.c_str());
+    }
+    if (m_wakeFd >= 0) close(m_wakeFd);
+    if (m_epollFd >= 0) close(m_epollFd);
+}
+
+bool VacDBServer::listenUnix(const string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 128) != 0) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    m_unixPath = path;
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+    m_listenFds.push_back(fd);
+    return true;
+}
+
+bool VacDBServer::listenTcp(int port) {
+    //only local clients are served
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 128) != 0) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+    m_listenFds.push_back(fd);
+    return true;
+}
+
+void VacDBServer::stop() {
+    m_stopping = true;
+    uint64_t one = 1;
+    ssize_t ignored = write(m_wakeFd, &one, sizeof(one));
+    (void) ignored;
+}
+
+bool VacDBServer::run() {
+    if (m_epollFd < 0 || m_wakeFd < 0) {
+        return false;
+    }
+    const int maxEvents = 64;
+    epoll_event events[maxEvents];
+
+    while (!m_stopping) {
+        int count = epoll_wait(m_epollFd, events, maxEvents, -1);
+        if (count < 0 && errno != EINTR) {
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == m_wakeFd) {
+                continue;
+            }
+            if (find(m_listenFds.begin(), m_listenFds.end(), fd) != m_listenFds.end()) {
+                acceptClients(fd);
+                continue;
+            }
+
+            auto found = m_connections.find(fd);
+            if (found == m_connections.end()) {
+                continue;
+            }
+            bool keep = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                keep = readClient(fd, found->second);
+            }
+            if (keep && (events[i].events & EPOLLOUT)) {
+                keep = writeClient(fd, found->second);
+            }
+            if (!keep) {
+                closeClient(fd);
+            }
+        }
+    }
+    return true;
+}
+
+void VacDBServer::acceptClients(int listenFd) {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        //responses are batched by the server itself
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            continue;
+        }
+        m_connections[fd].m_events = EPOLLIN;
+    }
+}
+
+bool VacDBServer::readClient(int fd, Connection &connection) {
+    char buffer[1 << 16];
+    bool open = true;
+    //while responses are backed up the requests stay in the socket buffer
+    while (connection.m_out.size() - connection.m_outSent < MAXCLIENTOUTPUT &&
+           connection.m_in.size() < MAXCLIENTINPUT) {
+        size_t wanted = min(sizeof(buffer), MAXCLIENTINPUT - connection.m_in.size());
+        ssize_t received = read(fd, buffer, wanted);
+        if (received > 0) {
+            connection.m_in.append(buffer, received);
+        } else if (received == 0) {
+            open = false;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+        //a full buffer is decoded before reading on, so it never holds more than one frame
+        if (connection.m_in.size() == MAXCLIENTINPUT && !executeRequests(connection)) {
+            return false;
+        }
+    }
+    return executeRequests(connection) && writeClient(fd, connection) && open;
+}
+
+bool VacDBServer::executeRequests(Connection &connection) {
+    //execute every complete request, a pipelined burst is answered with one write
+    size_t used = 0;
+    Request request;
+    while (connection.m_out.size() - connection.m_outSent < MAXCLIENTOUTPUT) {
+        long length = decodeRequest(connection.m_in.data() + used, connection.m_in.size() - used, request);
+        if (length < 0) {
+            return false;
+        }
+        if (length == 0) {
+            break;
+        }
+        //a response that does not fit a frame is treated like a malformed request
+        if (!execute(request, connection.m_out)) {
+            return false;
+        }
+        used += length;
+    }
+    connection.m_in.erase(0, used);
+    return true;
+}
+
+bool VacDBServer::writeClient(int fd, Connection &connection) {
+    while (connection.m_outSent < connection.m_out.size()) {
+        ssize_t sent = send(fd, connection.m_out.data() + connection.m_outSent,
+                            connection.m_out.size() - connection.m_outSent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection.m_outSent += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+        //requests held back by a full output buffer run as soon as it drains
+        if (connection.m_outSent == connection.m_out.size()) {
+            connection.m_out.clear();
+            connection.m_outSent = 0;
+            if (!executeRequests(connection)) {
+                return false;
+            }
+        }
+    }
+
+    size_t pending = connection.m_out.size() - connection.m_outSent;
+    if (pending == 0) {
+        connection.m_out.clear();
+        connection.m_outSent = 0;
+    } else if (connection.m_outSent > pending) {
+        //drop the sent prefix so a slow reader does not keep it alive
+        connection.m_out.erase(0, connection.m_outSent);
+        connection.m_outSent = 0;
+    }
+    //only wait for EPOLLOUT while something is left to send, and for EPOLLIN while there is room for responses
+    uint32_t events = (pending < MAXCLIENTOUTPUT ? uint32_t(EPOLLIN) : 0u) | (pending > 0 ? uint32_t(EPOLLOUT) : 0u);
+    if (events != connection.m_events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &event);
+        connection.m_events = events;
+    }
+    return true;
+}
+
+void VacDBServer::closeClient(int fd) {
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    m_connections.erase(fd);
+}
+
+bool VacDBServer::recordTrace(const string &path) {
+    stopRecording();
+    m_trace.reset(new TraceWriter());
+    if (!m_trace->open(path)) {
+        m_trace.reset();
+        return false;
+    }
+    return true;
+}
+
+void VacDBServer::stopRecording() {
+    if (m_trace) {
+        m_trace->close();
+        m_trace.reset();
+    }
+}
+
+bool VacDBServer::execute(const Request &request, string &out) {
+    Response response;
+    response.id = request.id;
+    response.statuses.reserve(request.patients.size());
+
+    for (const Patient &patient: request.patients) {
+        bool success = false;
+        switch (request.op) {
+            case OP_INSERT:
+            case OP_BATCHINSERT:
+                success = m_vacdb.insert(patient);
+                break;
+            case OP_REMOVE:
+            case OP_BATCHREMOVE:
+                success = m_vacdb.remove(patient);
+                break;
+            case OP_GET:
+            case OP_BATCHGET: {
+                Patient found = m_vacdb.getPatient(patient.getKey(), patient.getSerial());
+                success = !found.getKey().empty();
+                response.patients.push_back(found);
+                break;
+            }
+            case OP_UPDATE:
+                success = m_vacdb.updateSerialNumber(patient, request.newSerial);
+                break;
+        }
+        response.statuses.push_back(success);
+        if (m_trace) {
+            static const trace_op_t traceOps[] = {TRACE_INSERT, TRACE_REMOVE, TRACE_GET, TRACE_UPDATE,
+                                                  TRACE_INSERT, TRACE_REMOVE, TRACE_GET};
+            m_trace->record(traceOps[request.op - OP_INSERT], patient, request.newSerial);
+        }
+    }
+    m_requestsServed++;
+    return encodeResponse(request.op, response, out);
+}
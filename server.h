@@ -0,0 +1,62 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef SERVER_H
+#define SERVER_H
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vacdb.h"
+#include "protocol.h"
+#include "workload.h"
+using namespace std;
+const size_t MAXCLIENTINPUT = 4 + MAXFRAME;   // received bytes buffered per connection, one largest frame
+const size_t MAXCLIENTOUTPUT = 1 << 24;       // unsent response bytes after which a connection's requests wait
+// Serves one VacDB to many local clients over Unix or loopback TCP sockets
+// (see protocol.h). A single thread runs an epoll loop and executes requests
+// in arrival order, so the table needs no locking. A client that does not
+// read its responses stops being served once MAXCLIENTOUTPUT bytes are
+// waiting, so neither buffer of a connection grows without bound.
+class VacDBServer{
+public:
+    explicit VacDBServer(VacDB& vacdb);
+    ~VacDBServer();
+    // start listening; both may be used at the same time
+    bool listenUnix(const string& path);
+    bool listenTcp(int port);
+    // serves clients until stop() is called; returns false if epoll could not be set up
+    bool run();
+    // may be called from any thread or from a signal handler
+    void stop();
+    long requestsServed() const {return m_requestsServed;}
+    // appends every executed operation to a trace file (see workload.h) for later replay
+    bool recordTrace(const string& path);
+    void stopRecording();
+
+private:
+    struct Connection{
+        string m_in;            // received bytes not yet decoded
+        string m_out;           // encoded responses not yet sent
+        size_t m_outSent = 0;   // bytes of m_out already written
+        uint32_t m_events = 0;  // epoll events the connection is registered for
+    };
+    void acceptClients(int listenFd);
+    // returns false when the connection has to be closed
+    bool readClient(int fd, Connection& connection);
+    bool writeClient(int fd, Connection& connection);
+    bool executeRequests(Connection& connection);
+    void closeClient(int fd);
+    // false if the response cannot be encoded
+    bool execute(const Request& request, string& out);
+
+    VacDB&  m_vacdb;
+    int     m_epollFd;
+    int     m_wakeFd;               // eventfd that interrupts epoll_wait on stop()
+    vector<int> m_listenFds;
+    string  m_unixPath;             // removed again by the destructor
+    map<int, Connection> m_connections;
+    atomic<bool> m_stopping;
+    long    m_requestsServed;
+    unique_ptr<TraceWriter> m_trace; // null unless recording
+};
+#endif
@@ -0,0 +1,367 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "sharedvacdb.h"
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SHAREDMAGIC[8] = {'V', 'A', 'C', 'D', 'B', 'S', 'H', '1'};
+static const size_t HEADERBYTES = 4096;
+static const uint32_t NOSLOT = UINT32_MAX;
+
+struct SharedVacDB::Half{
+    uint32_t m_capacity;    // slots
+    uint32_t m_probing;     // prob_t
+    uint32_t m_size;        // entries including deleted ones, as in VacDB
+    uint32_t m_deleted;
+    uint64_t m_heapUsed;    // bytes of the half in use, slot array included
+};
+
+struct SharedVacDB::Header{
+    char     m_magic[8];
+    uint64_t m_bytes;
+    uint64_t m_halfBytes;
+    uint64_t m_generation;  // the half in use is m_halves[m_generation % 2]
+    Half     m_halves[2];
+};
+
+// 8-byte aligned in the heap, the name follows directly
+struct SharedVacDB::Entry{
+    int32_t m_serial;
+    uint8_t m_used;
+    uint8_t m_length;
+    char    m_name[2];
+};
+
+size_t SharedVacDB::entryBytes(size_t nameLength) {
+    return roundUp(offsetof(Entry, m_name) + nameLength, 8);
+}
+
+int SharedVacDB::capacityFor(int size) {
+    //the same range and rounding as the VacDB constructor
+    size = min(max(size, MINPRIME), MAXPRIME);
+    return VacDB::isPrime(size) ? size : VacDB::findNextPrime(size);
+}
+
+SharedVacDB::SharedVacDB() : m_base(nullptr), m_bytes(0), m_halfBytes(0), m_hash(nullptr), m_readOnly(true) {}
+
+SharedVacDB::~SharedVacDB() {
+    close();
+}
+
+bool SharedVacDB::create(const string &name, size_t bytes, hash_fn hash, prob_t probing, int size) {
+    close();
+    //entries are addressed by 32-bit offsets within their half
+    size_t halfBytes = min((bytes - min(bytes, HEADERBYTES)) / 2, size_t(UINT32_MAX)) / 8 * 8;
+    int capacity = capacityFor(size);
+    if (halfBytes < roundUp(size_t(capacity) * sizeof(uint32_t), 8) + entryBytes(255)) {
+        return false;
+    }
+    //truncating a segment that readers have mapped would make their next access fault,
+    //so an old segment is unlinked and stays alive until its last reader unmaps it
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    //a new segment reads as zeros: empty slots in both halves
+    void *base = ftruncate(fd, off_t(bytes)) == 0 ?
+                 mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    m_base = static_cast<char *>(base);
+    m_bytes = bytes;
+    m_halfBytes = halfBytes;
+    m_hash = hash;
+    m_readOnly = false;
+    Header *state = header();
+    state->m_bytes = bytes;
+    state->m_halfBytes = halfBytes;
+    state->m_generation = 0;
+    state->m_halves[0].m_capacity = uint32_t(capacity);
+    state->m_halves[0].m_probing = uint32_t(probing);
+    state->m_halves[0].m_heapUsed = roundUp(size_t(capacity) * sizeof(uint32_t), 8);
+    //readers check the magic first, so it goes in last
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(state->m_magic, SHAREDMAGIC, sizeof(SHAREDMAGIC));
+    return true;
+}
+
+bool SharedVacDB::open(const string &name, hash_fn hash) {
+    close();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && size_t(info.st_size) >= HEADERBYTES) {
+        base = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    m_base = static_cast<char *>(base);
+    m_bytes = size_t(info.st_size);
+    m_hash = hash;
+    m_readOnly = true;
+    const Header *state = header();
+    m_halfBytes = state->m_halfBytes;
+    if (memcmp(state->m_magic, SHAREDMAGIC, sizeof(SHAREDMAGIC)) != 0 || state->m_bytes != m_bytes ||
+        m_halfBytes % 8 != 0 || HEADERBYTES + 2 * m_halfBytes > m_bytes) {
+        close();
+        return false;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return true;
+}
+
+void SharedVacDB::close() {
+    if (m_base != nullptr) {
+        munmap(m_base, m_bytes);
+        m_base = nullptr;
+    }
+    m_bytes = 0;
+    m_halfBytes = 0;
+}
+
+bool SharedVacDB::unlink(const string &name) {
+    return shm_unlink(name.c_str()) == 0;
+}
+
+SharedVacDB::Half &SharedVacDB::half(uint64_t generation) const {
+    return header()->m_halves[generation % 2];
+}
+
+char *SharedVacDB::halfBase(uint64_t generation) const {
+    return m_base + HEADERBYTES + (generation % 2) * m_halfBytes;
+}
+
+uint64_t SharedVacDB::generation() const {
+    return m_base == nullptr ? 0 : __atomic_load_n(&header()->m_generation, __ATOMIC_ACQUIRE);
+}
+
+int SharedVacDB::capacity() const {
+    return m_base == nullptr ? 0 : int(__atomic_load_n(&half(generation()).m_capacity, __ATOMIC_RELAXED));
+}
+
+int SharedVacDB::numEntries() const {
+    if (m_base == nullptr) {
+        return 0;
+    }
+    const Half &current = half(generation());
+    return int(__atomic_load_n(&current.m_size, __ATOMIC_RELAXED) - __atomic_load_n(&current.m_deleted, __ATOMIC_RELAXED));
+}
+
+uint32_t SharedVacDB::find(uint64_t generation, const string &name, int serial, uint32_t *slot) const {
+    const Half &table = half(generation);
+    uint32_t capacity = __atomic_load_n(&table.m_capacity, __ATOMIC_RELAXED);
+    uint32_t probing = __atomic_load_n(&table.m_probing, __ATOMIC_RELAXED);
+    if (slot != nullptr) {
+        *slot = NOSLOT;
+    }
+    //a half being rebuilt may hold anything, the caller notices by the generation
+    if (capacity == 0 || size_t(capacity) * sizeof(uint32_t) > m_halfBytes || probing > LINEAR) {
+        return 0;
+    }
+
+    const char *base = halfBase(generation);
+    const uint32_t *slots = reinterpret_cast<const uint32_t *>(base);
+    unsigned int hash = m_hash(name);
+    unsigned int index = hash % capacity;
+    for (uint32_t i = 1; i <= capacity; i++) {
+        uint32_t offset = __atomic_load_n(&slots[index], __ATOMIC_ACQUIRE);
+        if (offset == 0) {
+            if (slot != nullptr && *slot == NOSLOT) {
+                *slot = index;
+            }
+            return 0;
+        }
+        if (offset % 8 != 0 || offset + entryBytes(0) > m_halfBytes) {
+            return 0;
+        }
+        const Entry *entry = reinterpret_cast<const Entry *>(base + offset);
+        if (!__atomic_load_n(&entry->m_used, __ATOMIC_RELAXED)) {
+            //the first tombstone is where the key would be inserted
+            if (slot != nullptr && *slot == NOSLOT) {
+                *slot = index;
+            }
+        } else if (entry->m_serial == serial && entry->m_length == name.size() &&
+                   offset + entryBytes(name.size()) <= m_halfBytes &&
+                   memcmp(entry->m_name, name.data(), name.size()) == 0) {
+            return offset;
+        }
+        index = VacDB::nextIndex(index, int(i), hash, int(capacity), prob_t(probing));
+    }
+    return 0;
+}
+
+const Patient SharedVacDB::getPatient(const string &name, int serial) const {
+    if (m_base == nullptr) {
+        return Patient();
+    }
+    while (true) {
+        uint64_t generation = __atomic_load_n(&header()->m_generation, __ATOMIC_ACQUIRE);
+        uint32_t offset = find(generation, name, serial);
+        Patient found;
+        if (offset != 0) {
+            const Entry *entry = reinterpret_cast<const Entry *>(halfBase(generation) + offset);
+            found = Patient(name, entry->m_serial, true);
+        }
+        //the lookup only counts if no rehash reused the half meanwhile
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header()->m_generation, __ATOMIC_RELAXED) == generation) {
+            return found;
+        }
+    }
+}
+
+uint32_t SharedVacDB::appendEntry(uint64_t generation, const string &name, int serial) {
+    Half &table = half(generation);
+    uint32_t offset = uint32_t(table.m_heapUsed);
+    Entry *entry = reinterpret_cast<Entry *>(halfBase(generation) + offset);
+    entry->m_serial = serial;
+    entry->m_used = 1;
+    entry->m_length = uint8_t(name.size());
+    memcpy(entry->m_name, name.data(), name.size());
+    table.m_heapUsed += entryBytes(name.size());
+    return offset;
+}
+
+bool SharedVacDB::insert(const Patient &patient) {
+    const string &name = patient.getKey();
+    if (m_base == nullptr || m_readOnly || name.size() > 255 ||
+        patient.getSerial() < MINID || patient.getSerial() > MAXID) {
+        return false;
+    }
+    uint64_t generation = header()->m_generation;
+    uint32_t slot = NOSLOT;
+    if (find(generation, name, patient.getSerial(), &slot) != 0) {
+        return false;
+    }
+    //without a free slot or heap space, or when the patient would take the table past half full,
+    //the table is rebuilt first, which also drops deleted entries; a table that cannot be rebuilt refuses the patient
+    auto fits = [&]() {
+        const Half &table = half(generation);
+        const uint32_t *slots = reinterpret_cast<const uint32_t *>(halfBase(generation));
+        return slot != NOSLOT && table.m_heapUsed + entryBytes(name.size()) <= m_halfBytes &&
+               (slots[slot] != 0 || double(table.m_size + 1) / table.m_capacity <= 0.5);
+    };
+    if (!fits()) {
+        Half &table = half(generation);
+        if (!rehash(capacityFor(4 * int(table.m_size - table.m_deleted + 1)))) {
+            return false;
+        }
+        generation = header()->m_generation;
+        find(generation, name, patient.getSerial(), &slot);
+        if (!fits()) {
+            return false;
+        }
+    }
+
+    Half &table = half(generation);
+    uint32_t *slots = reinterpret_cast<uint32_t *>(halfBase(generation));
+    uint32_t offset = appendEntry(generation, name, patient.getSerial());
+    if (slots[slot] != 0) {
+        table.m_deleted--;
+    } else {
+        table.m_size++;
+    }
+    //the entry is complete before readers can reach it
+    __atomic_store_n(&slots[slot], offset, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool SharedVacDB::remove(const Patient &patient) {
+    if (m_base == nullptr || m_readOnly) {
+        return false;
+    }
+    uint64_t generation = header()->m_generation;
+    uint32_t offset = find(generation, patient.getKey(), patient.getSerial());
+    if (offset == 0) {
+        return false;
+    }
+    Entry *entry = reinterpret_cast<Entry *>(halfBase(generation) + offset);
+    __atomic_store_n(&entry->m_used, uint8_t(0), __ATOMIC_RELEASE);
+    Half &table = half(generation);
+    table.m_deleted++;
+    if (double(table.m_deleted) / table.m_size > 0.8) {
+        rehash(capacityFor(4 * int(table.m_size - table.m_deleted)));
+    }
+    return true;
+}
+
+bool SharedVacDB::copyFrom(const VacDB &vacdb) {
+    bool success = true;
+    for (const Patient &patient: vacdb) {
+        if (!insert(patient) && getPatient(patient.getKey(), patient.getSerial()).getKey().empty()) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+bool SharedVacDB::rehash(int newCap) {
+    uint64_t generation = header()->m_generation;
+    const Half &from = half(generation);
+    Half &to = half(generation + 1);
+    const char *fromBase = halfBase(generation);
+    char *toBase = halfBase(generation + 1);
+    const uint32_t *fromSlots = reinterpret_cast<const uint32_t *>(fromBase);
+
+    size_t heapBytes = 0;
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < from.m_capacity; i++) {
+        const Entry *entry = reinterpret_cast<const Entry *>(fromBase + fromSlots[i]);
+        if (fromSlots[i] != 0 && entry->m_used) {
+            heapBytes += entryBytes(entry->m_length);
+            live++;
+        }
+    }
+    //a smaller table than asked for is better than none, as long as it stays at most half full
+    newCap = capacityFor(newCap);
+    while (roundUp(size_t(newCap) * sizeof(uint32_t), 8) + heapBytes > m_halfBytes && newCap > int(2 * live)) {
+        newCap = capacityFor(max(int(2 * live + 1), newCap / 2));
+    }
+    size_t slotBytes = roundUp(size_t(newCap) * sizeof(uint32_t), 8);
+    if (slotBytes + heapBytes > m_halfBytes || uint32_t(newCap) < 2 * live) {
+        return false;
+    }
+
+    //readers still in the other half notice the generation change and retry
+    memset(toBase, 0, slotBytes);
+    to.m_capacity = uint32_t(newCap);
+    to.m_probing = from.m_probing;
+    to.m_size = live;
+    to.m_deleted = 0;
+    to.m_heapUsed = slotBytes;
+    uint32_t *toSlots = reinterpret_cast<uint32_t *>(toBase);
+    for (uint32_t i = 0; i < from.m_capacity; i++) {
+        const Entry *entry = reinterpret_cast<const Entry *>(fromBase + fromSlots[i]);
+        if (fromSlots[i] == 0 || !entry->m_used) {
+            continue;
+        }
+        string name(entry->m_name, entry->m_length);
+        unsigned int hash = m_hash(name);
+        unsigned int index = hash % uint32_t(newCap);
+        //quadratic probing may cycle without reaching a free slot; the current half stays in use then
+        int step = 1;
+        for (; toSlots[index] != 0 && step < newCap; step++) {
+            index = VacDB::nextIndex(index, step, hash, newCap, prob_t(to.m_probing));
+        }
+        if (toSlots[index] != 0) {
+            return false;
+        }
+        toSlots[index] = appendEntry(generation + 1, name, entry->m_serial);
+    }
+    __atomic_store_n(&header()->m_generation, generation + 1, __ATOMIC_RELEASE);
+    return true;
+}
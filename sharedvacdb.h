@@ -0,0 +1,80 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef SHAREDVACDB_H
+#define SHAREDVACDB_H
+#include <cstdint>
+#include <string>
+#include "vacdb.h"
+using namespace std;
+// A patient table in a named POSIX shared-memory segment (shm_open), maintained
+// by one writer process and looked up directly by any number of reader processes
+// that map it read-only. Everything in the segment is addressed by offsets, so
+// each process may map it anywhere.
+//
+// Layout: a header page, then two equal halves. The half in use holds the slot
+// array (uint32 entry offsets, 0 = empty) followed by an append-only entry heap.
+// Inserts and removes change one word at a time in the half in use; a rehash
+// (also the only way heap space is reclaimed) builds the new table in the other
+// half and then publishes it by bumping the generation. Readers retry a lookup
+// whenever the generation moved while they were reading, and check every offset
+// against the segment bounds, so a lookup racing a rehash never faults.
+//
+// Writer and readers must use the same hash function, as with loadCheckpoint().
+class SharedVacDB{
+public:
+    SharedVacDB();
+    ~SharedVacDB();
+    SharedVacDB(const SharedVacDB&) = delete;
+    SharedVacDB& operator=(const SharedVacDB&) = delete;
+
+    // creates (or replaces) the segment name ("/something") of the given size for writing;
+    // a replaced segment is unlinked, not truncated, so readers still mapping it keep a valid copy
+    bool create(const string& name, size_t bytes, hash_fn hash, prob_t probing = DEFPOLCY, int size = MINPRIME);
+    // maps an existing segment read-only
+    bool open(const string& name, hash_fn hash);
+    void close();
+    // removes the name; mappings that are still open stay valid
+    static bool unlink(const string& name);
+
+    // the same semantics as in VacDB; false when read-only, when the name is longer than
+    // 255 bytes (an entry keeps its length in one byte), or when the table would pass half
+    // full and cannot be rebuilt because the live patients would not fit in half of the segment
+    bool insert(const Patient& patient);
+    bool remove(const Patient& patient);
+    // copies every live patient of vacdb
+    bool copyFrom(const VacDB& vacdb);
+    const Patient getPatient(const string& name, int serial) const;
+
+    bool isOpen() const {return m_base != nullptr;}
+    bool readOnly() const {return m_readOnly;}
+    // number of tables published so far (the generation of the table in use)
+    uint64_t generation() const;
+    int capacity() const;
+    // live patients in the table in use
+    int numEntries() const;
+
+private:
+    struct Header;
+    struct Half;
+    struct Entry;
+    Header* header() const {return reinterpret_cast<Header*>(m_base);}
+    Half& half(uint64_t generation) const;
+    char* halfBase(uint64_t generation) const;
+    // offset of the live entry with name and serial in the half of generation, 0 if absent
+    // slot receives the slot to insert at when reuse is wanted (first tombstone or empty slot)
+    uint32_t find(uint64_t generation, const string& name, int serial, uint32_t* slot = nullptr) const;
+    // slots of a table asked to hold size: a prime in MINPRIME..MAXPRIME, as in VacDB
+    static int capacityFor(int size);
+    // heap bytes taken by an entry with a name of nameLength characters
+    static size_t entryBytes(size_t nameLength);
+    // copies an entry to the heap of the half of generation, returns its offset
+    uint32_t appendEntry(uint64_t generation, const string& name, int serial);
+    // rebuilds the live patients into the other half with newCap slots and publishes it
+    bool rehash(int newCap);
+
+    char*    m_base;       // start of the mapping
+    size_t   m_bytes;      // length of the mapping
+    size_t   m_halfBytes;  // length of one half
+    hash_fn  m_hash;
+    bool     m_readOnly;
+};
+#endif
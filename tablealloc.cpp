@@ -0,0 +1,149 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "tablealloc.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+// from <numaif.h>, which would pull in libnuma for nothing but two constants
+static const int MEMPOLICYBIND = 2;
+static const int MEMPOLICYINTERLEAVE = 3;
+static const size_t HUGEPAGE = size_t(2) << 20;
+
+// sits right in front of every table; 64 bytes keep the slots cache-line aligned
+struct alignas(64) TableHeader{
+    void*  m_base;      // start of the allocation
+    size_t m_length;    // bytes allocated, header included
+    bool   m_mapped;    // mmap() rather than heap memory
+    page_t m_pages;
+};
+
+size_t roundUp(size_t bytes, size_t unit) {
+    return (bytes + unit - 1) / unit * unit;
+}
+
+static TableHeader *header(Patient **table) {
+    return reinterpret_cast<TableHeader *>(table) - 1;
+}
+
+//maps length bytes starting on an alignment boundary, or returns null
+static void *mapAligned(size_t length, size_t alignment) {
+    void *raw = mmap(nullptr, length + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t start = roundUp(uintptr_t(raw), alignment);
+    size_t head = start - uintptr_t(raw);
+    if (head > 0) {
+        munmap(raw, head);
+    }
+    munmap(reinterpret_cast<void *>(start + length), alignment - head);
+    return reinterpret_cast<void *>(start);
+}
+
+//best effort, a kernel without NUMA support keeps first-touch placement
+static void placePages(void *base, size_t length, const AllocationPolicy &policy) {
+    if (policy.numa == FIRSTTOUCH) {
+        return;
+    }
+    unsigned long nodeMask[16] = {};
+    const unsigned long maxNode = sizeof(nodeMask) * 8;
+    int mode = MEMPOLICYBIND;
+    if (policy.numa == INTERLEAVE) {
+        //every node; the kernel restricts the mask to the nodes this process may use
+        for (unsigned long &word: nodeMask) {
+            word = ~0UL;
+        }
+        mode = MEMPOLICYINTERLEAVE;
+    } else if (policy.node >= 0 && (unsigned long) policy.node < maxNode) {
+        nodeMask[policy.node / 64] = 1UL << (policy.node % 64);
+    } else {
+        return;
+    }
+    syscall(SYS_mbind, base, length, mode, nodeMask, maxNode, 0);
+}
+
+Patient **allocateTable(size_t slots, const AllocationPolicy &policy) {
+    size_t bytes = sizeof(TableHeader) + slots * sizeof(Patient *);
+    void *base = nullptr;
+    size_t length = 0;
+    page_t pages = policy.pages;
+
+    if (pages == EXPLICITHUGEPAGES) {
+        length = roundUp(bytes, HUGEPAGE);
+        base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            pages = TRANSPARENTHUGEPAGES;
+        }
+    }
+    if (base == nullptr && pages == TRANSPARENTHUGEPAGES) {
+        length = roundUp(bytes, HUGEPAGE);
+        base = mapAligned(length, HUGEPAGE);
+        if (base != nullptr) {
+            madvise(base, length, MADV_HUGEPAGE);
+        } else {
+            pages = STANDARDPAGES;
+        }
+    }
+    if (base == nullptr && policy.numa != FIRSTTOUCH) {
+        //page placement needs a mapping of its own
+        length = roundUp(bytes, size_t(sysconf(_SC_PAGESIZE)));
+        base = mapAligned(length, 64);
+        pages = STANDARDPAGES;
+    }
+    bool mapped = base != nullptr;
+    if (mapped) {
+        //the policy has to be in place before the first write faults the pages in
+        placePages(base, length, policy);
+    } else {
+        length = roundUp(bytes, 64);
+        pages = STANDARDPAGES;
+        base = aligned_alloc(64, length);
+        if (base == nullptr) {
+            throw bad_alloc();
+        }
+    }
+
+    TableHeader *tableHeader = static_cast<TableHeader *>(base);
+    tableHeader->m_base = base;
+    tableHeader->m_length = length;
+    tableHeader->m_pages = pages;
+    tableHeader->m_mapped = mapped;
+    Patient **table = reinterpret_cast<Patient **>(tableHeader + 1);
+    //anonymous mappings are zero already, and writing them would fault in every page
+    if (!mapped) {
+        for (size_t i = 0; i < slots; i++) {
+            table[i] = nullptr;
+        }
+    }
+    return table;
+}
+
+void freeTable(Patient **table) {
+    if (table == nullptr) {
+        return;
+    }
+    TableHeader *tableHeader = header(table);
+    if (!tableHeader->m_mapped) {
+        free(tableHeader->m_base);
+    } else {
+        munmap(tableHeader->m_base, tableHeader->m_length);
+    }
+}
+
+size_t tableBytes(Patient **const table) {
+    if (table == nullptr) {
+        return 0;
+    }
+    return header(table)->m_length;
+}
+
+page_t tablePages(Patient **const table) {
+    return table == nullptr ? STANDARDPAGES : header(table)->m_pages;
+}
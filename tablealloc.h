@@ -0,0 +1,34 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef TABLEALLOC_H
+#define TABLEALLOC_H
+#include <cstddef>
+using namespace std;
+class Patient;
+// Allocation of the Patient* slot arrays of VacDB. Tables are zero-filled and
+// freed with freeTable() whatever their backing; page and NUMA placement only
+// change where the kernel puts the memory, never the table contents.
+enum page_t {STANDARDPAGES, TRANSPARENTHUGEPAGES, EXPLICITHUGEPAGES};
+enum numa_t {FIRSTTOUCH, INTERLEAVE, BIND};
+
+struct AllocationPolicy{
+    // TRANSPARENTHUGEPAGES maps 2 MiB aligned memory and asks for THP with madvise();
+    // EXPLICITHUGEPAGES takes pages reserved in /proc/sys/vm/nr_hugepages (MAP_HUGETLB)
+    // and falls back to transparent ones when none are left. Both round the table up
+    // to whole 2 MiB pages, so they only pay off for large or hot tables.
+    page_t pages = STANDARDPAGES;
+    // INTERLEAVE spreads the pages round-robin over all nodes, BIND keeps them on
+    // node; FIRSTTOUCH leaves placement to whichever thread writes a page first
+    numa_t numa = FIRSTTOUCH;
+    int    node = 0;
+};
+
+// bytes rounded up to a multiple of unit
+size_t roundUp(size_t bytes, size_t unit);
+// a zero-filled array of slots entries, never null
+Patient** allocateTable(size_t slots, const AllocationPolicy& policy);
+void freeTable(Patient** table);
+// bytes actually mapped for the table, including rounding to whole pages
+size_t tableBytes(Patient** const table);
+// the backing the table got, which may differ from the one requested
+page_t tablePages(Patient** const table);
+#endif
@@ -1,5 +1,16 @@
 // CMSC 341 - Spring 2024 - Project 4
 #include "vacdb.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <mutex>
+#include <random>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 VacDB::VacDB(int size, hash_fn hash, prob_t probing = DEFPOLCY) {
     //set table size after validation
@@ -18,7 +29,7 @@ VacDB::VacDB(int size, hash_fn hash, prob_t probing = DEFPOLCY) {
     m_newPolicy = probing;
 
     //create memory for the current table
-    m_currentTable = new Patient *[m_currentCap]();
+    m_currentTable = allocateTable(m_currentCap, m_allocPolicy);
 
     //initialize all other member variables
     m_currentSize = 0;
@@ -30,24 +41,150 @@ VacDB::VacDB(int size, hash_fn hash, prob_t probing = DEFPOLCY) {
     m_oldNumDeleted = 0;
     m_oldProbing = probing;
     m_transferIndex = -1;
+    m_currMaxProbe = 0;
+    m_oldMaxProbe = 0;
+    m_hashSeed = 0;
+    m_chainSlack = CHAINSLACK;
+    m_chainAlarm = false;
+    m_guardGaveUp = false;
+    m_deterministicSeeds = false;
+    m_readView = nullptr;
+    m_filterBits = 0;
+    m_currentFilter = nullptr;
+    m_oldFilter = nullptr;
+    m_checkpointPid = 0;
+    m_checkpointPause = 0;
+    m_adaptiveProbing = false;
+    m_sampleTick = 0;
+    m_sampledHits = 0;
+    m_sampledMisses = 0;
+    m_sampledHitProbes = 0;
+    m_sampledMissProbes = 0;
+    m_cold = nullptr;
+    m_useClock = 0;
+    m_numPatients = 0;
+    m_aggregates = false;
+    m_changes = nullptr;
+    m_batching = false;
+    m_batchedTransfers = 0;
 }
 
 VacDB::~VacDB() {
+    //a child still writing a checkpoint has its own copy of the tables
+    if (m_checkpointPid > 0) {
+        finishCheckpoint();
+    }
+
     //deallocate current table and pointers
     for (int i = 0; i < m_currentCap; i++) {
         delete m_currentTable[i];
     }
-    delete[] m_currentTable;
+    freeTable(m_currentTable);
 
     //deallocate old table and pointers
     for (int i = 0; i < m_oldCap; i++) {
         delete m_oldTable[i];
     }
-    delete[] m_oldTable;
+    freeTable(m_oldTable);
+    delete m_currentFilter;
+    delete m_oldFilter;
+    //the segment files only back this object
+    if (m_cold != nullptr) {
+        m_cold->unlinkFiles();
+    }
+    delete m_cold;
+
+    //retired patients and tables are freed by the epoch manager
+    delete m_readView.load();
 }
 
 void VacDB::changeProbPolicy(prob_t policy) {
     m_newPolicy = policy;
+    m_adaptiveProbing = false;
+}
+
+void VacDB::setAdaptiveProbing(bool enabled) {
+    if (enabled && m_missHashes == nullptr) {
+        m_missHashes.reset(new atomic<unsigned int>[MISSSAMPLES]);
+    }
+    m_adaptiveProbing = enabled;
+}
+
+bool VacDB::setResizePolicy(const ResizePolicy &policy, prob_t probing) {
+    //right after a rehash the load is 1/growthFactor, which must not trigger another resize
+    double loadAfterRehash = 1 / policy.growthFactor;
+    if (policy.growthFactor <= 1 || policy.growThreshold >= 1 || policy.deletedThreshold <= 0 ||
+        loadAfterRehash >= policy.growThreshold || loadAfterRehash <= policy.shrinkThreshold) {
+        return false;
+    }
+    m_resizePolicy[probing] = policy;
+    return true;
+}
+
+bool VacDB::setResizePolicy(const ResizePolicy &policy) {
+    return setResizePolicy(policy, QUADRATIC) && setResizePolicy(policy, DOUBLEHASH) &&
+           setResizePolicy(policy, LINEAR);
+}
+
+ResizePolicy VacDB::getResizePolicy(prob_t probing) const {
+    return m_resizePolicy[probing];
+}
+
+void VacDB::reserve(int numEntries) {
+    //complete the transfer in progress so that only one table remains
+    while (m_transferIndex != -1) {
+        rehash();
+    }
+
+    //the reserved entries must fit below the grow threshold of the table
+    const ResizePolicy &policy = m_resizePolicy[m_newPolicy];
+    int needed = int(ceil(numEntries / policy.growThreshold)) + 1;
+    if (needed <= m_currentCap) {
+        return;
+    }
+    int newCap = findNextPrime(needed);
+    if (policy.maxBytes != 0) {
+        size_t available = policy.maxBytes - min(policy.maxBytes, footprint());
+        newCap = min(newCap, int(available / sizeof(Patient *)));
+        if (newCap <= m_currentCap) {
+            return;
+        }
+    }
+
+    beginRehash(newCap);
+    while (m_transferIndex != -1) {
+        rehash();
+    }
+}
+
+size_t VacDB::footprint() const {
+    //m_currentSize and m_oldSize include deleted entries, which are still allocated
+    return sizeof(VacDB) + tableBytes(m_currentTable) + tableBytes(m_oldTable) +
+           size_t(m_currentSize + m_oldSize) * sizeof(Patient) + getStats().filterBytes;
+}
+
+void VacDB::setAllocationPolicy(const AllocationPolicy &policy) {
+    m_allocPolicy = policy;
+    Patient **previous[2] = {m_currentTable, m_oldTable};
+    int previousCap[2] = {m_currentCap, m_oldCap};
+    Patient **moved[2] = {nullptr, nullptr};
+    for (int t = 0; t < 2; t++) {
+        if (previous[t] != nullptr) {
+            moved[t] = allocateTable(previousCap[t], policy);
+            for (int i = 0; i < previousCap[t]; i++) {
+                moved[t][i] = previous[t][i];
+            }
+        }
+    }
+    m_currentTable = moved[0];
+    m_oldTable = moved[1];
+    //readers switch over to the new arrays before the previous ones are freed
+    publishView();
+    for (int t = 0; t < 2; t++) {
+        if (previous[t] != nullptr) {
+            retireTable(previous[t], previousCap[t]);
+        }
+    }
 }
 
 bool VacDB::insert(Patient patient) {
@@ -56,122 +193,383 @@ bool VacDB::insert(Patient patient) {
 
     bool insertSuccessFlag = false;
 
-    //insert patient at calculated index if there is no duplicate and serial number is valid
-    if (!probe(index, patient.getKey(), patient.getSerial(), false) &&
-        !probe(index, patient.getKey(), patient.getSerial(), true) &&
-        patient.getSerial() >= MINID && patient.getSerial() <= MAXID) {
-
-        //if a patient already exists at calculated index, deallocate it
-        delete m_currentTable[index];
+    //when the table cannot grow within the memory budget, refuse patients above the grow threshold
+    const ResizePolicy &policy = m_resizePolicy[m_currProbing];
+    bool overBudget = policy.maxBytes != 0 && m_transferIndex == -1 &&
+                      (lambda() > policy.growThreshold || footprint() + sizeof(Patient) > policy.maxBytes);
 
-        //allocate memory for Patient object
-        Patient *newPatient = new Patient(patient.getKey(), patient.getSerial(), patient.getUsed());
+    //insert patient at calculated index if there is no duplicate and serial number is valid
+    int probeLength = 0;
+    if (!overBudget && !probe(index, patient.getKey(), patient.getSerial(), false) &&
+        !probe(index, patient.getKey(), patient.getSerial(), true, &probeLength) &&
+        patient.getSerial() >= MINID && patient.getSerial() <= MAXID &&
+        findCold(m_cold, patient.getKey(), patient.getSerial()) < 0) {
+        //placing a new patient walks the probe sequence like a miss
+        if (sampleNow()) {
+            sampleProbe(patient.getKey(), patient.getSerial(), false, probeLength);
+        }
 
-        //insert and update current number of entries
-        m_currentTable[index] = newPatient;
-        m_currentSize++;
+        //no free slot on the probe sequence: the chains are rebuilt and the patient gets one more try
+        if (m_currentTable[index] != nullptr && m_currentTable[index]->m_used) {
+            m_chainAlarm = true;
+            m_stats.chainAlarms++;
+            guardChains();
+            probe(index, patient.getKey(), patient.getSerial(), true, &probeLength);
+        }
+        if (m_currentTable[index] == nullptr || !m_currentTable[index]->m_used) {
+            placePatient(index, patient, probeLength);
 
-        //flag becomes true after insertion
-        insertSuccessFlag = true;
+            //flag becomes true after insertion
+            insertSuccessFlag = true;
+        }
     }
 
     //regardless of the output of the insert,
-    //if the load factor exceeds 50% after an insertion, rehash (or if rehash is already in progress, continue)
-    if (lambda() > 0.5 || m_transferIndex != -1) {
-        rehash();
+    //if the load factor exceeds the grow threshold after an insertion, rehash (or if rehash is already in progress, continue)
+    if (lambda() > policy.growThreshold || m_transferIndex != -1) {
+        rehashStep();
+    }
+    if (m_chainAlarm) {
+        guardChains();
+    }
+
+    //the tiered mode keeps the hot table at its size limit
+    if (insertSuccessFlag && m_tiering.maxHotEntries > 0 && hotEntries() > m_tiering.maxHotEntries) {
+        demoteColdest(max(1, int(hotEntries() * m_tiering.demoteFraction)));
     }
 
     return insertSuccessFlag;
 }
 
-bool VacDB::probe(unsigned int &index, string key, int serial, bool isCurrentTable) const {
-    //declare required variables
-    Patient **hashTable;
-    int capacity;
-    prob_t probingPolicy;
+void VacDB::placePatient(unsigned int index, const Patient &patient, int probeLength) {
+    //allocate memory for Patient object, live whatever the used flag of the caller's copy says,
+    //since it is counted as a live patient below
+    Patient *newPatient = new Patient(patient.getKey(), patient.getSerial(), true);
+    touch(newPatient);
 
-    bool softDeleteFound = false;
-    unsigned int firstSoftDeletedIndex = 0;
+    //the filter learns about the patient before readers can see it
+    if (m_currentFilter != nullptr) {
+        m_currentFilter->add(newPatient->m_name, newPatient->m_serial);
+    }
+
+    //insert and update current number of entries
+    //if a patient already exists at calculated index, deallocate it
+    Patient *replaced = m_currentTable[index];
+    storeSlot(&m_currentTable[index], newPatient);
+    retirePatient(replaced);
+    m_currentSize++;
+    m_currMaxProbe = max(m_currMaxProbe, probeLength);
+    checkChain(probeLength);
+    countPatient(newPatient->m_name, newPatient->m_serial, 1);
+    if (m_changes != nullptr) {
+        m_changes->changed(CHANGEINSERT, *newPatient, 0);
+    }
+}
+
+int VacDB::insertBulk(const vector<Patient> &patients) {
+    const ResizePolicy &policy = m_resizePolicy[m_currProbing];
+    int numInserted = 0;
+    //a memory budget and a hot table limit need the checks of insert() after every patient,
+    //and a short run gains nothing from being sorted
+    if (policy.maxBytes != 0 || m_tiering.maxHotEntries > 0 || int(patients.size()) < MINBULKINSERT) {
+        for (const Patient &patient: patients) {
+            numInserted += insert(patient);
+        }
+        return numInserted;
+    }
 
+    //one table, rebuilt as a rehash would if the patients take it past the grow threshold
+    while (m_transferIndex != -1) {
+        rehash();
+    }
+    if (m_currentSize + int(patients.size()) > policy.growThreshold * m_currentCap) {
+        beginRehash(nextCapacity(numLive() + int(patients.size())));
+        while (m_transferIndex != -1) {
+            rehash();
+        }
+    }
+
+    //placing the patients in home slot order walks the table once instead of jumping around it
+    vector<pair<unsigned int, int>> order;
+    order.reserve(patients.size());
+    for (int i = 0; i < int(patients.size()); i++) {
+        order.push_back({hashOf(patients[i].m_name, patients[i].m_serial, m_hashSeed) % m_currentCap, i});
+    }
+    sort(order.begin(), order.end());
+    for (pair<unsigned int, int> &next: order) {
+        const Patient &patient = patients[next.second];
+        unsigned int index = 0;
+        int probeLength = 0;
+        if (patient.m_serial >= MINID && patient.m_serial <= MAXID &&
+            !probe(index, patient.m_name, patient.m_serial, true, &probeLength) &&
+            findCold(m_cold, patient.m_name, patient.m_serial) < 0) {
+            //no free slot on the probe sequence
+            if (m_currentTable[index] != nullptr && m_currentTable[index]->m_used) {
+                m_chainAlarm = true;
+                m_stats.chainAlarms++;
+            }
+            //the rest of the run is placed in the rebuilt table, out of home slot order
+            if (m_chainAlarm) {
+                guardChains();
+                probe(index, patient.m_name, patient.m_serial, true, &probeLength);
+            }
+            if (m_currentTable[index] == nullptr || !m_currentTable[index]->m_used) {
+                placePatient(index, patient, probeLength);
+                numInserted++;
+            }
+        }
+    }
+
+    //reused soft-deleted slots aside, the table may still have filled past the threshold
+    if (lambda() > m_resizePolicy[m_currProbing].growThreshold) {
+        rehash();
+    }
+    if (m_chainAlarm) {
+        guardChains();
+    }
+    return numInserted;
+}
+
+bool VacDB::probe(unsigned int &index, string key, int serial, bool isCurrentTable, int *probeLength) const {
     //table in question changes based on boolean passed in
+    //a soft-deleted slot is only reused in the new table
+    unsigned int hash = hashOf(key, serial, m_hashSeed);
     if (isCurrentTable) {
-        hashTable = m_currentTable;
-        capacity = m_currentCap;
-        probingPolicy = m_currProbing;
-    } else {
-        hashTable = m_oldTable;
-        capacity = m_oldCap;
-        probingPolicy = m_oldProbing;
+        //an absent patient only needs the slot it would be inserted at, and only when it is being placed
+        if (m_currentFilter != nullptr && !m_currentFilter->mayContain(key, serial)) {
+            m_lookups.filterNegatives.fetch_add(1, memory_order_relaxed);
+            if (probeLength != nullptr) {
+                index = findFreeSlot(hash, m_currentTable, m_currentCap, m_currProbing, probeLength);
+            }
+            return false;
+        }
+        //entries of the current table are never further away than m_currMaxProbe steps either
+        bool found = findSlot(index, key, serial, hash, m_currentTable, m_currentCap, m_currProbing, true,
+                              probeLength, m_currMaxProbe);
+        //the walk ended after the longest chain without passing a free slot, the patient goes further along
+        if (!found && probeLength != nullptr && m_currentTable[index] != nullptr && m_currentTable[index]->m_used) {
+            index = findFreeSlot(hash, m_currentTable, m_currentCap, m_currProbing, probeLength);
+        }
+        if (m_currentFilter != nullptr && !found) {
+            m_lookups.filterFalsePositives.fetch_add(1, memory_order_relaxed);
+        }
+        return found;
     }
 
+    //no live entry is left where the key could be in the old table
+    if (m_oldTable != nullptr && oldChainTransferred(hash)) {
+        m_lookups.oldProbesSkipped.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    if (m_oldFilter != nullptr && !m_oldFilter->mayContain(key, serial)) {
+        m_lookups.filterNegatives.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    //entries of the old table are never further away than m_oldMaxProbe steps
+    bool found = findSlot(index, key, serial, hash, m_oldTable, m_oldCap, m_oldProbing, false, probeLength,
+                          m_oldMaxProbe);
+    if (m_oldFilter != nullptr && !found) {
+        m_lookups.filterFalsePositives.fetch_add(1, memory_order_relaxed);
+    }
+    return found;
+}
+
+unsigned int VacDB::findFreeSlot(unsigned int hash, Patient **hashTable, int capacity, prob_t probingPolicy,
+                                 int *probeLength) const {
+    unsigned int index = hash % capacity;
+    int i = 1;
+    //a QUADRATIC sequence may cycle through occupied slots only, so the walk is cut off
+    for (Patient *patient; i <= capacity && (patient = hashTable[index]) != nullptr && patient->m_used; i++) {
+        index = nextIndex(index, i, hash, capacity, probingPolicy);
+    }
+    if (probeLength != nullptr) *probeLength = i - 1;
+    return index;
+}
+
+Patient *VacDB::findSlot(unsigned int &index, const string &key, int serial, unsigned int hash,
+                         Patient **hashTable, int capacity, prob_t probingPolicy, bool reuseDeleted,
+                         int *probeLength, int maxProbe) const {
+    bool softDeleteFound = false;
+    unsigned int firstSoftDeletedIndex = 0;
+    int firstSoftDeletedLength = 0;
+
     //if table is empty
     if (hashTable == nullptr) {
-        return false;
+        return nullptr;
     }
 
     //calculate initial index
-    index = m_hash(key) % capacity;
+    index = hash % capacity;
 
-    //loop through table until an empty slot or match is found
-    for (int i = 1; hashTable[index] != nullptr; i++) {
+    //loop through table until an empty slot or match is found, or until the walk is cut off
+    if (maxProbe < 0) {
+        maxProbe = capacity;
+    }
+    Patient *patient;
+    int i = 1;
+    for (; (patient = loadSlot(&hashTable[index])) != nullptr && i - 1 <= maxProbe; i++) {
+        bool used = isLive(patient);
         //save first soft-deleted index in new table
-        if (hashTable == m_currentTable && !hashTable[index]->getUsed() && !softDeleteFound) {
+        if (reuseDeleted && !used && !softDeleteFound) {
             softDeleteFound = true;
             firstSoftDeletedIndex = index;
+            firstSoftDeletedLength = i - 1;
         }
-        //if match found, return true
-        if (hashTable[index]->getKey() == key && hashTable[index]->getSerial() == serial && hashTable[index]->getUsed()) {
-            return true;
+        //if match found, return it
+        if (used && patient->m_serial == serial && patient->m_name == key) {
+            if (probeLength != nullptr) *probeLength = i - 1;
+            return patient;
         }
         //increment index via probing policy
-        switch (probingPolicy) {
-            case LINEAR:
-                index = (index + 1) % capacity;
-                break;
-            case QUADRATIC:
-                index = (index + i * i) % capacity;
-                break;
-            case DOUBLEHASH:
-                index = ((m_hash(key) % capacity) + i * (11 - (m_hash(key) % 11))) % capacity;
-                break;
-        }
+        index = nextIndex(index, i, hash, capacity, probingPolicy);
     }
+    if (probeLength != nullptr) *probeLength = i - 1;
 
     //if match not found but a soft-delete is found, index should change
     //soft-deleted index has priority over empty index
     if (softDeleteFound) {
         index = firstSoftDeletedIndex;
+        if (probeLength != nullptr) *probeLength = firstSoftDeletedLength;
     }
 
-    return false;
+    return nullptr;
+}
+
+unsigned int VacDB::nextIndex(unsigned int index, int i, unsigned int hash, int capacity, prob_t probingPolicy) {
+    switch (probingPolicy) {
+        case LINEAR:
+            return (index + 1) % capacity;
+        case QUADRATIC:
+            //a chain may run to MAXPRIME steps, where i * i no longer fits an int
+            return (index + uint64_t(i) * i) % capacity;
+        case DOUBLEHASH:
+            return ((hash % capacity) + uint64_t(i) * (11 - (hash % 11))) % capacity;
+    }
+    return index;
+}
+
+bool VacDB::oldChainTransferred(unsigned int hash) const {
+    //distance from the home slot to the last position the key may occupy, if the sequence does not wrap
+    //then every position lies between the home slot and home + reach
+    long long home = hash % m_oldCap;
+    long long steps = m_oldMaxProbe;
+    long long reach = 0;
+    switch (m_oldProbing) {
+        case LINEAR:
+            reach = steps;
+            break;
+        case QUADRATIC:
+            //the offsets are cumulative sums of squares
+            reach = steps * (steps + 1) * (2 * steps + 1) / 6;
+            break;
+        case DOUBLEHASH:
+            //positions advance by a fixed step from the home slot
+            reach = steps * (11 - hash % 11);
+            break;
+    }
+    return home + reach < m_transferIndex;
+}
+
+unsigned int VacDB::hashOf(const string &key, int serial, unsigned int seed) const {
+    if (seed == 0) {
+        return m_hash(key);
+    }
+    //FNV-1a over the name bytes started from the seed, the serial folded in, then a final avalanche
+    uint32_t hash = seed;
+    for (unsigned char c: key) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    hash ^= uint32_t(serial) * 2654435761u;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+int VacDB::chainLimit(double slack) const {
+    //the longest chain of random keys grows with the log of the table size and with the load it may reach
+    double load = m_resizePolicy[m_currProbing].growThreshold;
+    double limit = slack * log2(double(m_currentCap)) / (1 - load);
+    return max(MINCHAINLIMIT, int(min(limit, double(m_currentCap))));
+}
+
+void VacDB::guardChains() {
+    m_chainAlarm = false;
+    //nothing rebuilt helped, trying again before the table changes would only repeat the work
+    if (m_guardGaveUp) {
+        return;
+    }
+    for (int attempt = 0; attempt < MAXRESEEDS; attempt++) {
+        //chains that survive a new seed are blamed on the clustering of the policy
+        if (attempt > 0 && m_newPolicy != DOUBLEHASH) {
+            m_newPolicy = DOUBLEHASH;
+            m_stats.policyFallbacks++;
+        }
+        if (rebuildTable(1, nextSeed(), true)) {
+            m_stats.reseeds++;
+            if (m_currMaxProbe <= chainLimit()) {
+                return;
+            }
+        }
+    }
+    //the seeds did not help at this size (or no table could be built), a lower load may
+    if (m_newPolicy != DOUBLEHASH) {
+        m_newPolicy = DOUBLEHASH;
+        m_stats.policyFallbacks++;
+    }
+    int grownCap = findNextPrime(int(m_resizePolicy[DOUBLEHASH].growthFactor * m_currentCap));
+    if (rebuildTable(1, nextSeed(), true, grownCap)) {
+        m_stats.guardGrowths++;
+        if (m_currMaxProbe <= chainLimit()) {
+            return;
+        }
+    }
+    //the keys need these chains whatever the seed, so the limit follows them instead of rebuilding at every
+    //insert; it stops growing once it allows the whole table
+    if (chainLimit() < m_currentCap) {
+        m_chainSlack *= 2;
+        m_stats.chainLimitRaises++;
+    }
+    m_guardGaveUp = true;
+}
+
+unsigned int VacDB::nextSeed() const {
+    unsigned int seed = m_hashSeed;
+    random_device device;
+    //seed 0 would mean m_hash again
+    do {
+        if (m_deterministicSeeds) {
+            seed += 0x9e3779b9u;
+            seed = (seed ^ (seed >> 16)) * 0x85ebca6bu;
+            seed = (seed ^ (seed >> 13)) * 0xc2b2ae35u;
+            seed ^= seed >> 16;
+        } else {
+            seed = device();
+        }
+    } while (seed == 0 || seed == m_hashSeed);
+    return seed;
+}
+
+void VacDB::tableBuilt() {
+    if (m_currMaxProbe <= chainLimit(CHAINSLACK)) {
+        m_chainSlack = CHAINSLACK;
+    }
+    m_guardGaveUp = false;
 }
 
 void VacDB::rehash() {
     //initial rehash setup
     if (m_transferIndex == -1) {
-        //move current table to old table
-        m_oldTable = m_currentTable;
-        m_oldCap = m_currentCap;
-        m_oldSize = m_currentSize;
-        m_oldNumDeleted = m_currNumDeleted;
-        m_oldProbing = m_currProbing;
-
-        //clear current table member variables to use as the "new" table
-        m_currentTable = nullptr;
-        m_currentCap = 0;
-        m_currentSize = 0;
-        m_currNumDeleted = 0;
-        m_currProbing = m_newPolicy;
-
         //calculate new table capacity
-        int numDataPoints = m_oldSize - m_oldNumDeleted;
-        m_currentCap = findNextPrime(4 * numDataPoints);
-
-        //zero-initiate new table
-        m_currentTable = new Patient *[m_currentCap]();
+        int newCap = nextCapacity(numLive());
 
-        //rehash is now in progress
-        m_transferIndex = 0;
+        //the table stays as it is if the memory budget does not allow a new one
+        if (newCap == 0) {
+            return;
+        }
+        beginRehash(newCap);
     }
 
     //calculate how many data points will be transferred in each rehash
@@ -193,32 +591,237 @@ void VacDB::rehash() {
             Patient *newPatient = new Patient(m_oldTable[m_transferIndex]->getKey(),
                                               m_oldTable[m_transferIndex]->getSerial(),
                                               true);
+            newPatient->m_lastUse = m_oldTable[m_transferIndex]->m_lastUse;
 
             //hash collisions are resolved using the probing policy
-            probe(newIndex, newPatient->getKey(), newPatient->getSerial(), true);
+            int probeLength = 0;
+            probe(newIndex, newPatient->getKey(), newPatient->getSerial(), true, &probeLength);
+            //without a free slot on the probe sequence the transfer stops here, the guard rebuilds both tables
+            if (m_currentTable[newIndex] != nullptr && m_currentTable[newIndex]->m_used) {
+                delete newPatient;
+                m_chainAlarm = true;
+                m_stats.chainAlarms++;
+                break;
+            }
+            m_currMaxProbe = max(m_currMaxProbe, probeLength);
+            checkChain(probeLength);
+
+            if (m_currentFilter != nullptr) {
+                m_currentFilter->add(newPatient->m_name, newPatient->m_serial);
+            }
 
             //insert and update current number of entries
-            m_currentTable[newIndex] = newPatient;
+            //a soft-deleted patient in the new table may be overwritten, deallocate it
+            Patient *replaced = m_currentTable[newIndex];
+            storeSlot(&m_currentTable[newIndex], newPatient);
+            retirePatient(replaced);
             m_currentSize++;
 
             //soft-delete data from old table after inserting into new table
-            m_oldTable[m_transferIndex]->setUsed(false);
+            //(a concurrent reader probes the old table first, so it always finds one of the copies)
+            markDeleted(m_oldTable[m_transferIndex]);
         }
     }
 
     //remove old table and deallocate its memory once all rehashing is complete
     if (m_transferIndex == m_oldCap) {
-        for (int i = 0; i < m_oldCap; i++) {
-            delete m_oldTable[i];
-        }
-        delete[] m_oldTable;
+        Patient **oldTable = m_oldTable;
+        int oldCap = m_oldCap;
 
         m_oldTable = nullptr;
         m_oldCap = 0;
         m_oldSize = 0;
         m_oldNumDeleted = 0;
+        m_oldMaxProbe = 0;
         m_transferIndex = -1;
+        BloomFilter *oldFilter = m_oldFilter;
+        m_oldFilter = nullptr;
+        publishView();
+
+        retireFilter(oldFilter);
+        for (int i = 0; i < oldCap; i++) {
+            retirePatient(oldTable[i]);
+        }
+        retireTable(oldTable, oldCap);
+        tableBuilt();
+    }
+
+    //a rebuild by the guard also ends the transfer
+    if (m_chainAlarm) {
+        guardChains();
+    }
+}
+
+void VacDB::beginBatch() {
+    m_batching = true;
+    m_batchedTransfers = 0;
+}
+
+long VacDB::endBatch() {
+    m_batching = false;
+    long steps = 0;
+    //a transfer that finished early needs no further steps
+    for (; steps < m_batchedTransfers && m_transferIndex != -1; steps++) {
+        rehash();
     }
+    m_batchedTransfers = 0;
+    return steps;
+}
+
+void VacDB::beginRehash(int newCap) {
+    if (m_adaptiveProbing) {
+        m_newPolicy = chooseProbing(newCap);
+    }
+
+    //move current table to old table
+    m_oldTable = m_currentTable;
+    m_oldCap = m_currentCap;
+    m_oldSize = m_currentSize;
+    m_oldNumDeleted = m_currNumDeleted;
+    m_oldProbing = m_currProbing;
+    m_oldMaxProbe = m_currMaxProbe;
+    m_oldFilter = m_currentFilter;
+
+    //clear current table member variables to use as the "new" table
+    m_currentTable = nullptr;
+    m_currentCap = newCap;
+    m_currentSize = 0;
+    m_currNumDeleted = 0;
+    m_currProbing = m_newPolicy;
+    m_currMaxProbe = 0;
+    m_currentFilter = newFilter(newCap);
+
+    //zero-initiate new table
+    m_currentTable = allocateTable(m_currentCap, m_allocPolicy);
+
+    //rehash is now in progress
+    m_transferIndex = 0;
+    publishView();
+}
+
+void VacDB::sampleProbe(const string &key, int serial, bool found, int probeLength) const {
+    if (found) {
+        m_sampledHits.fetch_add(1, memory_order_relaxed);
+        m_sampledHitProbes.fetch_add(probeLength, memory_order_relaxed);
+        return;
+    }
+    long misses = m_sampledMisses.fetch_add(1, memory_order_relaxed) + 1;
+    m_sampledMissProbes.fetch_add(probeLength, memory_order_relaxed);
+    //reservoir sample of the absent keys seen since the last rehash
+    unsigned int hash = hashOf(key, serial, m_hashSeed);
+    size_t slot = size_t(misses - 1);
+    if (misses > MISSSAMPLES) {
+        slot = size_t(hash ^ m_sampleTick.load(memory_order_relaxed)) % size_t(misses);
+    }
+    if (slot < size_t(MISSSAMPLES)) {
+        m_missHashes[slot].store(hash, memory_order_relaxed);
+    }
+}
+
+prob_t VacDB::chooseProbing(int newCap) {
+    //switching only pays off when the expected saving is above noise
+    const double margin = 0.03;
+    //walks are cut off here, a policy that gets this far is out of the running anyway
+    const int maxWalk = 64;
+    ProbingDecision decision;
+    decision.previous = m_newPolicy;
+    decision.capacity = newCap;
+
+    //the home slots of all live patients; a sample scaled down to a smaller table would
+    //lose exactly the clustering of hash values that separates the policies
+    vector<unsigned int> keys;
+    keys.reserve(numLive() + (m_oldSize - m_oldNumDeleted));
+    for (int t = 0; t < 2; t++) {
+        Patient **table = t == 0 ? m_currentTable : m_oldTable;
+        int capacity = t == 0 ? m_currentCap : m_oldCap;
+        //slots below the transfer index of the old table have been copied to the current one
+        for (int i = t == 0 ? 0 : max(m_transferIndex, 0); i < capacity && table != nullptr; i++) {
+            if (table[i] != nullptr && table[i]->m_used) {
+                keys.push_back(hashOf(table[i]->m_name, table[i]->m_serial, m_hashSeed));
+            }
+        }
+    }
+    long samples = m_sampledHits + m_sampledMisses;
+    decision.sampledKeys = int(keys.size());
+    decision.missFraction = samples > 0 ? double(m_sampledMisses) / double(samples) : 0.5;
+    decision.observedHitProbes = m_sampledHits > 0 ? double(m_sampledHitProbes) / double(m_sampledHits) : 0;
+    decision.observedMissProbes = m_sampledMisses > 0 ? double(m_sampledMissProbes) / double(m_sampledMisses) : 0;
+
+    vector<unsigned int> misses;
+    for (long i = 0; m_missHashes != nullptr && i < min(long(MISSSAMPLES), m_sampledMisses.load()); i++) {
+        misses.push_back(m_missHashes[i].load(memory_order_relaxed));
+    }
+    for (unsigned int i = 0; misses.size() < 256; i++) {
+        //not enough absent keys observed, probe from arbitrary home slots instead
+        unsigned int hash = (i + 1) * 2654435761u;
+        misses.push_back(hash ^ (hash >> 15));
+    }
+    decision.sampledMisses = int(misses.size());
+
+    //cost of a walk: one access per patient compared plus one per slot cache line entered
+    const int slotsPerLine = 64 / sizeof(Patient *);
+    vector<bool> occupied(newCap);
+    for (prob_t policy: {QUADRATIC, DOUBLEHASH, LINEAR}) {
+        fill(occupied.begin(), occupied.end(), false);
+        double hitCost = 0, missCost = 0;
+        for (unsigned int hash: keys) {
+            unsigned int index = hash % newCap;
+            int accesses = 2;
+            for (int i = 1; occupied[index] && i <= maxWalk; i++) {
+                unsigned int next = nextIndex(index, i, hash, newCap, policy);
+                accesses += 1 + (int(next) / slotsPerLine != int(index) / slotsPerLine);
+                index = next;
+            }
+            occupied[index] = true;
+            hitCost += accesses;
+        }
+        for (unsigned int hash: misses) {
+            unsigned int index = hash % newCap;
+            int accesses = 1;
+            for (int i = 1; occupied[index] && i <= maxWalk; i++) {
+                unsigned int next = nextIndex(index, i, hash, newCap, policy);
+                accesses += 1 + (int(next) / slotsPerLine != int(index) / slotsPerLine);
+                index = next;
+            }
+            missCost += accesses;
+        }
+        decision.predictedCost[policy] = (1 - decision.missFraction) * hitCost / max(double(keys.size()), 1.0) +
+                                         decision.missFraction * missCost / double(misses.size());
+    }
+
+    prob_t best = m_newPolicy;
+    for (prob_t policy: {QUADRATIC, DOUBLEHASH, LINEAR}) {
+        if (decision.predictedCost[policy] < decision.predictedCost[best] * (1 - margin)) {
+            best = policy;
+        }
+    }
+    decision.chosen = best;
+    m_stats.probingDecisions++;
+    m_stats.lastProbingDecision = decision;
+
+    //the evidence is about the table being replaced
+    m_sampledHits = m_sampledMisses = 0;
+    m_sampledHitProbes = m_sampledMissProbes = 0;
+    return best;
+}
+
+int VacDB::nextCapacity(int numLive) {
+    const ResizePolicy &policy = m_resizePolicy[m_newPolicy];
+    int newCap = findNextPrime(int(policy.growthFactor * numLive));
+    if (policy.maxBytes == 0) {
+        return newCap;
+    }
+
+    //both tables and the copied entries exist until the transfer finishes
+    size_t used = footprint() + size_t(numLive) * sizeof(Patient);
+    size_t available = policy.maxBytes - min(policy.maxBytes, used);
+    newCap = min(newCap, int(available / sizeof(Patient *)));
+
+    //a table that would be above the grow threshold right away is not worth building
+    if (newCap < MINPRIME || numLive >= policy.growThreshold * newCap) {
+        return 0;
+    }
+    return newCap;
 }
 
 bool VacDB::remove(Patient patient) {
@@ -228,19 +831,34 @@ bool VacDB::remove(Patient patient) {
 
     //if patient found in either table, mark patient as deleted (soft-delete) and set success flag to true
     if (probe(index, patient.getKey(), patient.getSerial(), true)) {
-        m_currentTable[index]->setUsed(false);
+        markDeleted(m_currentTable[index]);
         m_currNumDeleted++;
         removeSuccessFlag = true;
     } else if (probe(index, patient.getKey(), patient.getSerial(), false)) {
-        m_oldTable[index]->setUsed(false);
+        markDeleted(m_oldTable[index]);
         m_oldNumDeleted++;
         removeSuccessFlag = true;
+    } else if (m_cold != nullptr) {
+        long record = findCold(m_cold, patient.getKey(), patient.getSerial());
+        m_cold->remove(record);
+        removeSuccessFlag = record >= 0;
     }
+    if (removeSuccessFlag) {
+        countPatient(patient.getKey(), patient.getSerial(), -1);
+        if (m_changes != nullptr) {
+            m_changes->changed(CHANGEREMOVE, patient, 0);
+        }
+    }
+
+    //a table whose live load dropped below the shrink threshold gives memory back
+    const ResizePolicy &policy = m_resizePolicy[m_currProbing];
+    bool shrink = m_transferIndex == -1 && float(numLive()) / float(m_currentCap) < policy.shrinkThreshold &&
+                  findNextPrime(int(policy.growthFactor * numLive())) < m_currentCap;
 
     //regardless of the output of the remove,
-    //if the deleted ratio exceeds 80% after a deletion, rehash (or if rehash is already in progress, continue)
-    if (deletedRatio() > 0.8 || m_transferIndex != -1) {
-        rehash();
+    //if the deleted ratio exceeds the deleted threshold after a deletion, rehash (or if rehash is already in progress, continue)
+    if (deletedRatio() > policy.deletedThreshold || shrink || m_transferIndex != -1) {
+        rehashStep();
     }
 
     //if patient is not found, return false
@@ -248,19 +866,596 @@ bool VacDB::remove(Patient patient) {
 }
 
 const Patient VacDB::getPatient(string name, int serial) const {
+    if (m_epochs != nullptr) {
+        return getPatientConcurrent(name, serial);
+    }
+
     unsigned int index = 0;
 
-    //return the Patient object with the passed-in name and the vaccine serial number in the database
-    if (probe(index, name, serial, true)) {
-        return *m_currentTable[index];
-    } else if (probe(index, name, serial, false)) {
-        return *m_oldTable[index];
+    //a sampled lookup also measures its walk through the current table
+    if (sampleNow()) {
+        int probeLength = 0;
+        bool filtered = m_currentFilter != nullptr && !m_currentFilter->mayContain(name, serial);
+        bool found = probe(index, name, serial, true, &probeLength);
+        //misses the filter answered cost the same under every policy
+        if (found || !filtered) {
+            sampleProbe(name, serial, found, probeLength);
+        }
+        if (found) {
+            touch(m_currentTable[index]);
+            return Patient(name, serial, true);
+        }
+    } else if (probe(index, name, serial, true)) {
+        //the copy is built from the key, since other lookups may be stamping the patient's m_lastUse
+        touch(m_currentTable[index]);
+        return Patient(name, serial, true);
+    }
+    if (probe(index, name, serial, false)) {
+        touch(m_oldTable[index]);
+        return Patient(name, serial, true);
+    }
+    //patients not in memory may have been demoted
+    if (findCold(m_cold, name, serial) >= 0) {
+        return Patient(name, serial, true);
     }
 
     //if object is not found, return empty object
     return Patient();
 }
 
+const Patient VacDB::getPatientConcurrent(const string &name, int serial) const {
+    EpochGuard guard(*m_epochs);
+    unsigned int index = 0;
+
+    while (true) {
+        const ReadView *view = m_readView.load(memory_order_acquire);
+        //the chain lengths of the writer are not published, the walks are only bounded by the capacity
+        unsigned int hash = hashOf(name, serial, view->m_hashSeed);
+
+        //the old table is probed first: a transfer publishes the new copy before soft-deleting the old one
+        Patient *found = nullptr;
+        if (view->m_oldFilter == nullptr || view->m_oldFilter->mayContain(name, serial)) {
+            found = findSlot(index, name, serial, hash, view->m_oldTable, view->m_oldCap, view->m_oldProbing, false);
+        }
+        if (found == nullptr && (view->m_currentFilter == nullptr || view->m_currentFilter->mayContain(name, serial))) {
+            found = findSlot(index, name, serial, hash, view->m_currentTable, view->m_currentCap,
+                             view->m_currProbing, false);
+        }
+        if (found != nullptr) {
+            return Patient(found->m_name, found->m_serial, true);
+        }
+        //a demotion publishes the new segment before the patients leave the table
+        if (findCold(view->m_cold, name, serial) >= 0) {
+            return Patient(name, serial, true);
+        }
+
+        //a miss only counts if the tables were not swapped meanwhile (the patient may have moved)
+        if (view == m_readView.load(memory_order_acquire)) {
+            return Patient();
+        }
+    }
+}
+
+void VacDB::enableConcurrentReaders() {
+    if (m_epochs == nullptr) {
+        m_epochs.reset(new EpochManager());
+        publishView();
+    }
+}
+
+void VacDB::publishView() {
+    if (m_epochs == nullptr) {
+        return;
+    }
+    ReadView *view = new ReadView{m_currentTable, m_currentCap, m_currProbing, m_oldTable, m_oldCap, m_oldProbing,
+                                  m_currentFilter, m_oldFilter, m_cold, m_hashSeed};
+    ReadView *previous = m_readView.exchange(view, memory_order_acq_rel);
+    if (previous != nullptr) {
+        m_epochs->retire(previous, [](void *ptr, size_t) { delete static_cast<ReadView *>(ptr); });
+    }
+}
+
+void VacDB::retirePatient(Patient *patient) {
+    if (patient == nullptr) {
+        return;
+    }
+    if (m_epochs == nullptr) {
+        delete patient;
+    } else {
+        m_epochs->retire(patient, [](void *ptr, size_t) { delete static_cast<Patient *>(ptr); });
+    }
+}
+
+void VacDB::retireTable(Patient **table, int capacity) {
+    if (m_epochs == nullptr) {
+        freeTable(table);
+    } else {
+        m_epochs->retire(table, [](void *ptr, size_t) { freeTable(static_cast<Patient **>(ptr)); }, capacity);
+    }
+}
+
+void VacDB::retireFilter(BloomFilter *filter) {
+    if (m_epochs == nullptr) {
+        delete filter;
+    } else if (filter != nullptr) {
+        m_epochs->retire(filter, [](void *ptr, size_t) { delete static_cast<BloomFilter *>(ptr); });
+    }
+}
+
+void VacDB::retireTier(ColdTier *tier) {
+    if (m_epochs == nullptr) {
+        delete tier;
+    } else if (tier != nullptr) {
+        m_epochs->retire(tier, [](void *ptr, size_t) { delete static_cast<ColdTier *>(ptr); });
+    }
+}
+
+long VacDB::findCold(const ColdTier *cold, const string &name, int serial) const {
+    if (cold == nullptr) {
+        return -1;
+    }
+    long record = cold->find(m_hash(name), name, serial);
+    (record >= 0 ? m_lookups.coldHits : m_lookups.coldMisses).fetch_add(1, memory_order_relaxed);
+    return record;
+}
+
+bool VacDB::enableTiering(const string &path, const TieringPolicy &policy) {
+    if (!m_coldPath.empty() || path.empty()) {
+        return false;
+    }
+    m_coldPath = path;
+    m_tiering = policy;
+    return true;
+}
+
+int VacDB::demoteColdest(int count) {
+    if (m_coldPath.empty() || count <= 0) {
+        return 0;
+    }
+    //with a single table every live patient has one slot
+    while (m_transferIndex != -1) {
+        rehash();
+    }
+
+    //the count patients whose stamp is furthest behind the clock; stamps wrap, so age is taken modulo 2^16
+    uint16_t now = uint16_t(m_useClock.load(memory_order_relaxed) >> RECENCYSHIFT);
+    vector<pair<uint16_t, int>> candidates;
+    candidates.reserve(numLive());
+    for (int i = 0; i < m_currentCap; i++) {
+        Patient *patient = m_currentTable[i];
+        if (patient != nullptr && patient->m_used) {
+            candidates.push_back({uint16_t(now - patient->m_lastUse), i});
+        }
+    }
+    count = min(count, int(candidates.size()));
+    if (count == 0) {
+        return 0;
+    }
+    nth_element(candidates.begin(), candidates.begin() + (count - 1), candidates.end(),
+                [](const pair<uint16_t, int> &lhs, const pair<uint16_t, int> &rhs) { return lhs.first > rhs.first; });
+
+    //only the demoted patients are written, as a new run of the cold tier
+    vector<ColdEntry> entries;
+    entries.reserve(count);
+    for (int c = 0; c < count; c++) {
+        Patient *patient = m_currentTable[candidates[c].second];
+        entries.push_back({m_hash(patient->m_name), patient->m_serial, patient->m_name});
+    }
+    ColdTier *tier = ColdTier::push(m_cold, m_coldPath, entries);
+    if (tier == nullptr) {
+        return 0;
+    }
+    ColdTier *previous = m_cold;
+    m_cold = tier;
+    publishView();
+    retireTier(previous);
+
+    //readers find the patients in the segment from now on, the table lets go of them
+    for (int c = 0; c < count; c++) {
+        markDeleted(m_currentTable[candidates[c].second]);
+        m_currNumDeleted++;
+    }
+    m_tierStats.demotions++;
+    m_tierStats.demotedPatients += count;
+    //the demoted slots are reclaimed like removed ones, once the deleted ratio calls for a rehash
+    if (deletedRatio() > m_resizePolicy[m_currProbing].deletedThreshold) {
+        rehashStep();
+    }
+    return count;
+}
+
+TierStats VacDB::getTierStats() const {
+    TierStats stats = m_tierStats;
+    stats.coldHits = m_lookups.coldHits.load(memory_order_relaxed);
+    stats.coldMisses = m_lookups.coldMisses.load(memory_order_relaxed);
+    stats.hotEntries = hotEntries();
+    if (m_cold != nullptr) {
+        const ResizePolicy &policy = m_resizePolicy[m_currProbing];
+        stats.coldEntries = m_cold->numLive();
+        stats.coldFileBytes = m_cold->fileBytes();
+        stats.coldRuns = m_cold->numRuns();
+        stats.mergedPatients = m_cold->mergedRecords();
+        stats.coldMemoryBytes = m_cold->memoryBytes();
+        //a patient in the table takes its object and growthFactor slots once the table is rebuilt
+        size_t perPatient = sizeof(Patient) + size_t(policy.growthFactor * sizeof(Patient *));
+        size_t inTable = size_t(stats.coldEntries) * perPatient;
+        stats.memorySavedBytes = inTable - min(inTable, stats.coldMemoryBytes);
+    }
+    return stats;
+}
+
+void VacDB::countPatient(const string &name, int serial, int delta) {
+    m_numPatients += delta;
+    if (m_aggregates) {
+        //names without live patients are dropped so that numNames() stays exact
+        auto count = m_nameCounts.find(name);
+        if (count == m_nameCounts.end()) {
+            m_nameCounts.emplace(name, delta);
+        } else if ((count->second += delta) == 0) {
+            m_nameCounts.erase(count);
+        }
+        m_serialCounts[serial - MINID] += delta;
+    }
+}
+
+void VacDB::recount() {
+    m_numPatients = 0;
+    m_nameCounts.clear();
+    m_serialCounts.assign(m_aggregates ? MAXID - MINID + 1 : 0, 0);
+    for (const Patient &patient: *this) {
+        countPatient(patient.m_name, patient.m_serial, 1);
+    }
+    if (m_cold != nullptr) {
+        vector<ColdEntry> entries;
+        m_cold->liveEntries(entries);
+        for (ColdEntry &entry: entries) {
+            countPatient(entry.name, entry.serial, 1);
+        }
+    }
+}
+
+void VacDB::enableAggregates() {
+    if (!m_aggregates) {
+        m_aggregates = true;
+        recount();
+    }
+}
+
+int VacDB::countOfName(const string &name) const {
+    if (!m_aggregates) {
+        return -1;
+    }
+    auto count = m_nameCounts.find(name);
+    return count == m_nameCounts.end() ? 0 : count->second;
+}
+
+int VacDB::countOfSerial(int serial) const {
+    if (!m_aggregates) {
+        return -1;
+    }
+    return serial >= MINID && serial <= MAXID ? m_serialCounts[serial - MINID] : 0;
+}
+
+void VacDB::enableNegativeFilter(int bitsPerEntry) {
+    if (m_filterBits != 0 || bitsPerEntry <= 0) {
+        return;
+    }
+    m_filterBits = bitsPerEntry;
+    rebuildFilters();
+}
+
+void VacDB::rebuildFilters() {
+    //both filters start out with every live patient of their table
+    BloomFilter *currentFilter = newFilter(m_currentCap);
+    for (int i = 0; currentFilter != nullptr && i < m_currentCap; i++) {
+        if (m_currentTable[i] != nullptr && m_currentTable[i]->m_used) {
+            currentFilter->add(m_currentTable[i]->m_name, m_currentTable[i]->m_serial);
+        }
+    }
+    BloomFilter *oldFilter = nullptr;
+    if (m_oldTable != nullptr) {
+        oldFilter = newFilter(m_oldCap);
+        for (int i = 0; oldFilter != nullptr && i < m_oldCap; i++) {
+            if (m_oldTable[i] != nullptr && m_oldTable[i]->m_used) {
+                oldFilter->add(m_oldTable[i]->m_name, m_oldTable[i]->m_serial);
+            }
+        }
+    }
+
+    BloomFilter *previousCurrent = m_currentFilter;
+    BloomFilter *previousOld = m_oldFilter;
+    m_currentFilter = currentFilter;
+    m_oldFilter = oldFilter;
+    publishView();
+    retireFilter(previousCurrent);
+    retireFilter(previousOld);
+}
+
+BloomFilter *VacDB::newFilter(int capacity) const {
+    if (m_filterBits == 0) {
+        return nullptr;
+    }
+    //the table grows (and gets a new filter) before it holds more than growThreshold * capacity entries
+    return new BloomFilter(int(capacity * m_resizePolicy[m_newPolicy].growThreshold) + 1, m_filterBits);
+}
+
+VacDBStats VacDB::getStats() const {
+    VacDBStats stats = m_stats;
+    stats.oldProbesSkipped = m_lookups.oldProbesSkipped.load(memory_order_relaxed);
+    stats.filterNegatives = m_lookups.filterNegatives.load(memory_order_relaxed);
+    stats.filterFalsePositives = m_lookups.filterFalsePositives.load(memory_order_relaxed);
+    stats.chainLimit = chainLimit();
+    stats.longestChain = m_currMaxProbe;
+    stats.hashSeed = m_hashSeed;
+    stats.tablePages = tablePages(m_currentTable);
+    if (m_currentFilter != nullptr) {
+        stats.filterExpectedFalsePositiveRate = m_currentFilter->falsePositiveRate(m_currentSize);
+        stats.filterBytes += m_currentFilter->memoryBytes();
+    }
+    if (m_oldFilter != nullptr) {
+        stats.filterBytes += m_oldFilter->memoryBytes();
+    }
+    return stats;
+}
+
+// checkpoint file layout (native byte order):
+//   "VACDBCK2", then the table state as int32: new policy, transfer index, hash seed,
+//   and for the current and then the old table: capacity, size, deleted, probing, max probe;
+//   then the entries of the current and then the old table, each list ended by slot -1:
+//   int32 slot, int32 serial, uint8 used, uint32 name length, name bytes
+// slots are kept as they are, so tombstones and a rehash in progress are restored exactly
+// "VACDBCK1" files have no hash seed and are read with seed 0
+static const char CHECKPOINTMAGIC[8] = {'V', 'A', 'C', 'D', 'B', 'C', 'K', '2'};
+
+// buffers output in a fixed array and writes it with write(2)
+class CheckpointWriter{
+public:
+    explicit CheckpointWriter(int fd) : m_fd(fd), m_used(0), m_ok(true) {}
+    void put(const void *data, size_t size) {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0) {
+            size_t chunk = min(size, sizeof(m_buffer) - m_used);
+            memcpy(m_buffer + m_used, bytes, chunk);
+            m_used += chunk;
+            bytes += chunk;
+            size -= chunk;
+            if (m_used == sizeof(m_buffer)) {
+                flush();
+            }
+        }
+    }
+    void putInt(int32_t value) {put(&value, sizeof(value));}
+    bool flush() {
+        for (size_t written = 0; m_ok && written < m_used;) {
+            ssize_t result = write(m_fd, m_buffer + written, m_used - written);
+            if (result < 0 && errno != EINTR) {
+                m_ok = false;
+            } else if (result > 0) {
+                written += result;
+            }
+        }
+        m_used = 0;
+        return m_ok;
+    }
+private:
+    int m_fd;
+    size_t m_used;
+    bool m_ok;
+    char m_buffer[1 << 16];
+};
+
+bool VacDB::writeCheckpoint(int fd) const {
+    CheckpointWriter out(fd);
+    out.put(CHECKPOINTMAGIC, sizeof(CHECKPOINTMAGIC));
+    out.putInt(m_newPolicy);
+    out.putInt(m_transferIndex);
+    out.putInt(int32_t(m_hashSeed));
+
+    Patient **tables[2] = {m_currentTable, m_oldTable};
+    int capacities[2] = {m_currentCap, m_oldCap};
+    int sizes[2] = {m_currentSize, m_oldSize};
+    int deleted[2] = {m_currNumDeleted, m_oldNumDeleted};
+    int probing[2] = {m_currProbing, m_oldProbing};
+    int maxProbe[2] = {m_currMaxProbe, m_oldMaxProbe};
+    for (int t = 0; t < 2; t++) {
+        out.putInt(capacities[t]);
+        out.putInt(sizes[t]);
+        out.putInt(deleted[t]);
+        out.putInt(probing[t]);
+        out.putInt(maxProbe[t]);
+    }
+
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < capacities[t]; i++) {
+            const Patient *patient = tables[t][i];
+            if (patient == nullptr) {
+                continue;
+            }
+            uint8_t used = patient->m_used;
+            uint32_t length = patient->m_name.size();
+            out.putInt(i);
+            out.putInt(patient->m_serial);
+            out.put(&used, sizeof(used));
+            out.put(&length, sizeof(length));
+            out.put(patient->m_name.data(), length);
+        }
+        out.putInt(-1);
+    }
+    return out.flush();
+}
+
+bool VacDB::startCheckpoint(const string &path) {
+    if (m_checkpointPid > 0) {
+        return false;
+    }
+    //everything the child needs is prepared before the fork, the child itself only writes
+    m_checkpointPath = path;
+    m_checkpointTempPath = path + ".tmp";
+    const char *finalPath = m_checkpointPath.c_str();
+    const char *tempPath = m_checkpointTempPath.c_str();
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        //the child sees the tables as they were at the fork, whatever the parent does next
+        int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 && writeCheckpoint(fd);
+        ok = fd >= 0 && close(fd) == 0 && ok;
+        ok = ok && rename(tempPath, finalPath) == 0;
+        _exit(ok ? 0 : 1);
+    }
+
+    m_checkpointPid = pid;
+    m_checkpointStart = chrono::steady_clock::now();
+    m_checkpointPause = chrono::duration<double>(m_checkpointStart - start).count();
+    return true;
+}
+
+CheckpointStats VacDB::finishCheckpoint() {
+    CheckpointStats stats;
+    if (m_checkpointPid <= 0) {
+        return stats;
+    }
+
+    int status = 0;
+    while (waitpid(m_checkpointPid, &status, 0) < 0 && errno == EINTR) {
+    }
+    m_checkpointPid = 0;
+
+    struct stat fileInfo;
+    stats.success = WIFEXITED(status) && WEXITSTATUS(status) == 0 && stat(m_checkpointPath.c_str(), &fileInfo) == 0;
+    stats.pauseSeconds = m_checkpointPause;
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - m_checkpointStart).count();
+    if (stats.success) {
+        stats.bytes = fileInfo.st_size;
+        stats.megabytesPerSecond = stats.bytes / 1e6 / stats.seconds;
+    }
+    return stats;
+}
+
+bool VacDB::loadCheckpoint(const string &path) {
+    ifstream in(path, ios::binary);
+    char magic[sizeof(CHECKPOINTMAGIC)];
+    auto getInt = [&in]() {
+        int32_t value = 0;
+        in.read(reinterpret_cast<char *>(&value), sizeof(value));
+        return value;
+    };
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, CHECKPOINTMAGIC, sizeof(magic) - 1) != 0 ||
+        (magic[7] != '1' && magic[7] != '2')) {
+        return false;
+    }
+
+    int newPolicy = getInt();
+    int transferIndex = getInt();
+    unsigned int seed = magic[7] == '2' ? unsigned(getInt()) : 0;
+    int capacities[2], sizes[2], deleted[2], probing[2], maxProbe[2];
+    for (int t = 0; t < 2; t++) {
+        capacities[t] = getInt();
+        sizes[t] = getInt();
+        deleted[t] = getInt();
+        probing[t] = getInt();
+        maxProbe[t] = getInt();
+        if (!in || capacities[t] < 0 || capacities[t] > MAXPRIME || probing[t] < QUADRATIC || probing[t] > LINEAR ||
+            deleted[t] < 0 || deleted[t] > sizes[t] || sizes[t] - deleted[t] > capacities[t] || maxProbe[t] < 0 ||
+            maxProbe[t] > capacities[t]) {
+            return false;
+        }
+    }
+    //a transfer is in progress exactly when there is an old table, and its index lies within that table
+    bool transferValid = capacities[1] == 0 ? transferIndex == -1 : transferIndex >= 0 && transferIndex <= capacities[1];
+    if (capacities[0] == 0 || newPolicy < QUADRATIC || newPolicy > LINEAR || !transferValid) {
+        return false;
+    }
+
+    //read both tables before touching the current contents; the sizes and deleted counts are taken
+    //from the entries themselves, the header's only have to be plausible
+    Patient **tables[2] = {allocateTable(capacities[0], m_allocPolicy),
+                           capacities[1] > 0 ? allocateTable(capacities[1], m_allocPolicy) : nullptr};
+    int entries[2] = {0, 0}, deletedEntries[2] = {0, 0};
+    bool ok = true;
+    for (int t = 0; t < 2 && ok; t++) {
+        for (int slot = getInt(); ok && slot != -1; slot = getInt()) {
+            int serial = getInt();
+            uint8_t used = 0;
+            uint32_t length = 0;
+            in.read(reinterpret_cast<char *>(&used), sizeof(used));
+            in.read(reinterpret_cast<char *>(&length), sizeof(length));
+            //the transfer has already moved the live patients of the old table below its index
+            ok = in && slot >= 0 && slot < capacities[t] && tables[t][slot] == nullptr && length < (1u << 20) &&
+                 serial >= MINID && serial <= MAXID && (t == 0 || used == 0 || slot >= transferIndex);
+            if (ok) {
+                string name(length, '\0');
+                ok = bool(in.read(&name[0], length));
+                tables[t][slot] = new Patient(name, serial, used != 0);
+                entries[t]++;
+                deletedEntries[t] += used == 0;
+            }
+        }
+        ok = ok && bool(in);
+    }
+    //lookups stop after maxProbe steps, so every live patient must be reachable within them
+    for (int t = 0; t < 2 && ok; t++) {
+        for (int slot = 0; ok && slot < capacities[t]; slot++) {
+            const Patient *patient = tables[t][slot];
+            if (patient == nullptr || !patient->m_used) {
+                continue;
+            }
+            unsigned int hash = hashOf(patient->m_name, patient->m_serial, seed);
+            unsigned int index = hash % capacities[t];
+            for (int i = 1; int(index) != slot && i <= maxProbe[t]; i++) {
+                index = nextIndex(index, i, hash, capacities[t], prob_t(probing[t]));
+            }
+            ok = int(index) == slot;
+        }
+    }
+    if (!ok) {
+        for (int t = 0; t < 2; t++) {
+            for (int i = 0; i < capacities[t]; i++) {
+                delete tables[t][i];
+            }
+            freeTable(tables[t]);
+        }
+        return false;
+    }
+
+    //swap in the loaded tables, the previous ones are retired like after a rehash
+    Patient **previous[2] = {m_currentTable, m_oldTable};
+    int previousCap[2] = {m_currentCap, m_oldCap};
+    m_newPolicy = prob_t(newPolicy);
+    m_transferIndex = transferIndex;
+    m_hashSeed = seed;
+    m_currentTable = tables[0];
+    m_currentCap = capacities[0];
+    m_currentSize = entries[0];
+    m_currNumDeleted = deletedEntries[0];
+    m_currProbing = prob_t(probing[0]);
+    m_currMaxProbe = maxProbe[0];
+    m_oldTable = tables[1];
+    m_oldCap = capacities[1];
+    m_oldSize = entries[1];
+    m_oldNumDeleted = deletedEntries[1];
+    m_oldProbing = prob_t(probing[1]);
+    m_oldMaxProbe = maxProbe[1];
+    publishView();
+    rebuildFilters();
+    recount();
+    tableBuilt();
+
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < previousCap[t]; i++) {
+            retirePatient(previous[t][i]);
+        }
+        if (previous[t] != nullptr) {
+            retireTable(previous[t], previousCap[t]);
+        }
+    }
+    return true;
+}
+
 bool VacDB::updateSerialNumber(Patient patient, int serial) {
     //call getPatient to search the database
     Patient foundPatient = getPatient(patient.getKey(), patient.getSerial());
@@ -269,10 +1464,22 @@ bool VacDB::updateSerialNumber(Patient patient, int serial) {
     if (foundPatient.getKey().empty() && foundPatient.getSerial() == 0 && !foundPatient.getUsed()) {
         return false;
     }
+    if (serial == foundPatient.getSerial()) {
+        return true;
+    }
 
-    //otherwise, update its serial number and return true
+    //the filters and the probe sequences know the patient by name and serial, so the new key is inserted
+    //first (insert rejects an invalid or taken serial) and only then is the old one removed
     foundPatient.setSerial(serial);
-    return true;
+    //a listener hears of the update rather than of the insert and remove it is made of
+    ChangeListener *listener = m_changes;
+    m_changes = nullptr;
+    bool success = insert(foundPatient) && remove(patient);
+    m_changes = listener;
+    if (success && m_changes != nullptr) {
+        m_changes->changed(CHANGEUPDATE, patient, serial);
+    }
+    return success;
 }
 
 float VacDB::lambda() const {
@@ -286,16 +1493,340 @@ float VacDB::deletedRatio() const {
 }
 
 void VacDB::dump() const {
-    cout << "Dump for the current table: " << endl;
+    //one flush at the end rather than one per slot (exportPatients() is the fast way out)
+    cout << "Dump for the current table: " << '\n';
     if (m_currentTable != nullptr)
         for (int i = 0; i < m_currentCap; i++) {
-            cout << "[" << i << "] : " << m_currentTable[i] << endl;
+            cout << "[" << i << "] : " << m_currentTable[i] << '\n';
         }
-    cout << "Dump for the old table: " << endl;
+    cout << "Dump for the old table: " << '\n';
     if (m_oldTable != nullptr)
         for (int i = 0; i < m_oldCap; i++) {
-            cout << "[" << i << "] : " << m_oldTable[i] << endl;
+            cout << "[" << i << "] : " << m_oldTable[i] << '\n';
         }
+    cout << flush;
+}
+
+Patient *VacDB::slotAt(int slot) const {
+    if (slot < m_currentCap) {
+        return m_currentTable[slot];
+    }
+    return m_oldTable[slot - m_currentCap];
+}
+
+void VacDB::const_iterator::advance() {
+    //skip empty and soft-deleted slots
+    int last = m_db->numSlots();
+    while (m_index < last && (slot() == nullptr || !slot()->getUsed())) {
+        m_index++;
+    }
+}
+
+int VacDB::numWorkers(int numThreads) const {
+    //a worker should have at least a few thousand slots to scan to be worth starting
+    const int minSlotsPerWorker = 4096;
+    if (numThreads <= 0) {
+        numThreads = max(1, int(thread::hardware_concurrency()));
+    }
+    return max(1, min(numThreads, numSlots() / minSlotsPerWorker));
+}
+
+void VacDB::parallelForEach(const function<void(const Patient &)> &visit, int numThreads) const {
+    int workers = numWorkers(numThreads);
+    int chunk = (numSlots() + workers - 1) / workers;
+    vector<thread> threads;
+
+    for (int w = 0; w < workers; w++) {
+        threads.emplace_back([&, w]() {
+            int first = w * chunk;
+            scanSlots(first, min(first + chunk, numSlots()), visit);
+        });
+    }
+    for (thread &worker: threads) {
+        worker.join();
+    }
+}
+
+// runs work(0) on the calling thread and work(1) ... work(workers - 1) on helper threads
+static void runWorkers(int workers, const function<void(int)> &work) {
+    vector<thread> threads;
+    for (int w = 1; w < workers; w++) {
+        threads.emplace_back(work, w);
+    }
+    work(0);
+    for (thread &worker: threads) {
+        worker.join();
+    }
+}
+
+bool VacDB::rehashNow(int numThreads) {
+    return rebuildTable(numThreads, m_hashSeed, false);
+}
+
+bool VacDB::rebuildTable(int numThreads, unsigned int seed, bool reseeding, int newCap) {
+    struct Placement{
+        Patient *patient;
+        unsigned int hash;
+    };
+    int workers = numWorkers(numThreads);
+    int slots = numSlots();
+    int chunk = (slots + workers - 1) / workers;
+
+    //every worker collects the live patients of a contiguous slot range of both tables
+    vector<vector<Placement>> collected(workers);
+    runWorkers(workers, [&](int w) {
+        for (int i = w * chunk; i < min(slots, (w + 1) * chunk); i++) {
+            Patient *patient = slotAt(i);
+            if (patient != nullptr && patient->m_used) {
+                collected[w].push_back({patient, hashOf(patient->m_name, patient->m_serial, seed)});
+            }
+        }
+    });
+    int live = 0;
+    for (vector<Placement> &list: collected) {
+        live += int(list.size());
+    }
+
+    //a new seed does not need a new size, the guard keeps the capacity unless the patients outgrew it
+    if (newCap == 0 && reseeding && live < m_resizePolicy[m_newPolicy].growThreshold * m_currentCap) {
+        newCap = m_currentCap;
+    } else if (newCap == 0) {
+        newCap = nextCapacity(live);
+    }
+    //the new slot array exists next to the present ones until it is complete
+    size_t maxBytes = m_resizePolicy[m_newPolicy].maxBytes;
+    if (newCap == 0 || (maxBytes != 0 && footprint() + size_t(newCap) * sizeof(Patient *) > maxBytes)) {
+        return false;
+    }
+    //the simulation of chooseProbing() hashes with the seed in use, not the new one
+    if (m_adaptiveProbing && !reseeding) {
+        m_newPolicy = chooseProbing(newCap);
+    }
+    prob_t policy = m_newPolicy;
+    Patient **table = allocateTable(newCap, m_allocPolicy);
+
+    //worker p owns the slot range [p * newCap / workers, (p + 1) * newCap / workers), so every
+    //patient is handed to the worker owning its home slot
+    auto owner = [&](unsigned int index) { return int((long long) index * workers / newCap); };
+    vector<vector<vector<Placement>>> buckets(workers, vector<vector<Placement>>(workers));
+    runWorkers(workers, [&](int w) {
+        for (Placement &placement: collected[w]) {
+            buckets[w][owner(placement.hash % newCap)].push_back(placement);
+        }
+    });
+
+    //a worker places a patient if its probe sequence reaches a free slot without leaving the
+    //worker's range; one that runs into a neighbour's range is deferred
+    vector<vector<Placement>> deferred(workers);
+    vector<int> maxProbe(workers, 0);
+    runWorkers(workers, [&](int p) {
+        for (int w = 0; w < workers; w++) {
+            for (Placement &placement: buckets[w][p]) {
+                unsigned int index = placement.hash % newCap;
+                int i = 1;
+                for (; owner(index) == p && table[index] != nullptr && i <= newCap; i++) {
+                    index = nextIndex(index, i, placement.hash, newCap, policy);
+                }
+                if (owner(index) == p && table[index] == nullptr) {
+                    table[index] = placement.patient;
+                    maxProbe[p] = max(maxProbe[p], i - 1);
+                } else {
+                    deferred[p].push_back(placement);
+                }
+            }
+        }
+    });
+
+    //every slot a deferred patient passed is taken by now, so the usual walk finds its place
+    int numDeferred = 0;
+    int longestProbe = *max_element(maxProbe.begin(), maxProbe.end());
+    for (vector<Placement> &list: deferred) {
+        numDeferred += int(list.size());
+        for (Placement &placement: list) {
+            unsigned int index = placement.hash % newCap;
+            int i = 1;
+            for (; table[index] != nullptr && i <= newCap; i++) {
+                index = nextIndex(index, i, placement.hash, newCap, policy);
+            }
+            //a QUADRATIC sequence that only cycles through taken slots, the patients stay where they are
+            if (table[index] != nullptr) {
+                freeTable(table);
+                return false;
+            }
+            table[index] = placement.patient;
+            longestProbe = max(longestProbe, i - 1);
+        }
+    }
+
+    //the live patients moved over as they are, only the arrays and soft-deleted entries go
+    Patient **previous[2] = {m_currentTable, m_oldTable};
+    int previousCap[2] = {m_currentCap, m_oldCap};
+    m_currentTable = table;
+    m_currentCap = newCap;
+    m_currentSize = live;
+    m_currNumDeleted = 0;
+    m_currProbing = policy;
+    m_currMaxProbe = longestProbe;
+    m_oldTable = nullptr;
+    m_oldCap = 0;
+    m_oldSize = 0;
+    m_oldNumDeleted = 0;
+    m_oldMaxProbe = 0;
+    m_transferIndex = -1;
+    m_hashSeed = seed;
+    //publishes the new table to concurrent readers together with its filter
+    rebuildFilters();
+
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < previousCap[t]; i++) {
+            if (previous[t][i] != nullptr && !previous[t][i]->m_used) {
+                retirePatient(previous[t][i]);
+            }
+        }
+        if (previous[t] != nullptr) {
+            retireTable(previous[t], previousCap[t]);
+        }
+    }
+    if (!reseeding) {
+        m_stats.parallelRehashes++;
+        m_stats.parallelDeferred = numDeferred;
+    }
+    tableBuilt();
+    return true;
+}
+
+map<string, int> VacDB::countByName(int numThreads) const {
+    return parallelReduce(map<string, int>(),
+                          [](map<string, int> &counts, const Patient &patient) { counts[patient.getKey()]++; },
+                          [](map<string, int> &result, const map<string, int> &partial) {
+                              for (const auto &count: partial) result[count.first] += count.second;
+                          },
+                          numThreads);
+}
+
+map<int, int> VacDB::countBySerial(int numThreads) const {
+    return parallelReduce(map<int, int>(),
+                          [](map<int, int> &counts, const Patient &patient) { counts[patient.getSerial()]++; },
+                          [](map<int, int> &result, const map<int, int> &partial) {
+                              for (const auto &count: partial) result[count.first] += count.second;
+                          },
+                          numThreads);
+}
+
+ExportStats VacDB::exportPatients(const ExportSink &sink, const ExportOptions &options) const {
+    //slots per partition, small enough that the partitions formatted ahead of the sink take little memory
+    const int partitionSlots = 8192;
+    auto start = chrono::steady_clock::now();
+    ExportStats stats;
+    stats.success = true;
+    string pending;
+    pending.reserve(options.bufferBytes + 4096);
+    appendExportHeader(pending, options.format);
+
+    //hands pending to the sink once it holds bufferBytes, or whatever is left when final is set
+    auto drain = [&](bool final) {
+        if (stats.success && !pending.empty() && (final || pending.size() >= options.bufferBytes)) {
+            stats.success = sink(pending.data(), pending.size());
+            stats.bytes += pending.size();
+            pending.clear();
+        }
+        return stats.success;
+    };
+    auto formatSlots = [&](int first, int last, string &out) {
+        long records = 0;
+        scanSlots(first, last, [&](const Patient &patient) {
+            if (exportSelects(options, patient.m_name, patient.m_serial)) {
+                appendExportRecord(out, patient.m_name, patient.m_serial, options.format);
+                records++;
+            }
+        });
+        return records;
+    };
+
+    int slots = numSlots();
+    int numPartitions = (slots + partitionSlots - 1) / partitionSlots;
+    int workers = min(numWorkers(options.numThreads), numPartitions);
+    if (workers <= 1) {
+        for (int p = 0; p < numPartitions && drain(false); p++) {
+            stats.records += formatSlots(p * partitionSlots, min(slots, (p + 1) * partitionSlots), pending);
+        }
+    } else {
+        //workers take the partitions in turn and stay at most window partitions ahead of the sink,
+        //which is fed by the calling thread in partition order
+        int window = 4 * workers;
+        vector<string> formatted(numPartitions);
+        vector<long> records(numPartitions, 0);
+        vector<bool> ready(numPartitions, false);
+        int nextPartition = 0, drained = 0;
+        bool stopped = false;
+        mutex lock;
+        condition_variable changed;
+
+        vector<thread> threads;
+        for (int w = 0; w < workers; w++) {
+            threads.emplace_back([&]() {
+                unique_lock<mutex> guard(lock);
+                while (true) {
+                    changed.wait(guard, [&]() {
+                        return stopped || nextPartition == numPartitions || nextPartition < drained + window;
+                    });
+                    if (stopped || nextPartition == numPartitions) {
+                        return;
+                    }
+                    int p = nextPartition++;
+                    guard.unlock();
+                    string out;
+                    out.reserve(size_t(partitionSlots) * 8);
+                    long count = formatSlots(p * partitionSlots, min(slots, (p + 1) * partitionSlots), out);
+                    guard.lock();
+                    formatted[p].swap(out);
+                    records[p] = count;
+                    ready[p] = true;
+                    changed.notify_all();
+                }
+            });
+        }
+        for (int p = 0; p < numPartitions; p++) {
+            string out;
+            {
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [&]() { return bool(ready[p]); });
+                out.swap(formatted[p]);
+                drained = p + 1;
+            }
+            changed.notify_all();
+            stats.records += records[p];
+            pending += out;
+            if (!drain(false)) {
+                break;
+            }
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            stopped = true;
+        }
+        changed.notify_all();
+        for (thread &worker: threads) {
+            worker.join();
+        }
+    }
+
+    //the cold tier follows the tables
+    if (m_cold != nullptr && stats.success) {
+        vector<ColdEntry> entries;
+        m_cold->liveEntries(entries);
+        for (ColdEntry &entry: entries) {
+            if (exportSelects(options, entry.name, entry.serial)) {
+                appendExportRecord(pending, entry.name, entry.serial, options.format);
+                stats.records++;
+                drain(false);
+            }
+        }
+    }
+    drain(true);
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stats.recordsPerSecond = stats.seconds > 0 ? stats.records / stats.seconds : 0;
+    return stats;
 }
 
 bool VacDB::isPrime(int number) {
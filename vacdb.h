@@ -3,25 +3,127 @@
 #define VACDB_H
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "math.h"
+#include "epoch.h"
+#include "bloomfilter.h"
+#include "tablealloc.h"
+#include "coldsegment.h"
+#include "export.h"
 using namespace std;
 const int MINID = 1000;     // serial number
 const int MAXID = 9999;     // serial number
 const int MINPRIME = 101;   // Min size for hash table
 const int MAXPRIME = 99991; // Max size for hash table
+const unsigned int SAMPLEPERIOD = 64; // adaptive probing samples one operation in this many
+const int MISSSAMPLES = 1024;         // absent keys adaptive probing keeps for its simulation
+const int RECENCYSHIFT = 6;           // tiered mode: recency stamps advance once every 64 operations
+const int MINBULKINSERT = 512;        // insertBulk() places shorter runs with insert()
+const int MINCHAINLIMIT = 32;         // probe chains up to this length never set off the chain guard
+const int MAXRESEEDS = 3;             // rebuilds the chain guard tries before it grows the table
+const double CHAINSLACK = 4;          // chain guard limit in multiples of the expected longest chain, until raised
 typedef unsigned int (*hash_fn)(string); // declaration of hash function
 enum prob_t {QUADRATIC, DOUBLEHASH, LINEAR}; // types of collision handling policy
 #define DEFPOLCY QUADRATIC
+// decides when the table is resized and how large the new table is
+// the defaults reproduce the project specification
+struct ResizePolicy{
+    double growThreshold = 0.5;     // rehash when the load factor exceeds this after an insert
+    double shrinkThreshold = 0;     // rehash when the live load drops below this after a remove (0 disables)
+    double deletedThreshold = 0.8;  // rehash when the deleted ratio exceeds this after a remove
+    double growthFactor = 4;        // the new capacity is growthFactor times the number of live entries
+    size_t maxBytes = 0;            // memory budget for slots and entries of both tables (0 is unlimited)
+};
+// why an adaptive rehash built its table with the policy it did
+struct ProbingDecision{
+    prob_t chosen = DEFPOLCY;
+    prob_t previous = DEFPOLCY;       // the policy it would have used otherwise
+    int    capacity = 0;              // of the table being built
+    int    sampledKeys = 0;           // live keys placed in the simulated tables
+    int    sampledMisses = 0;         // absent keys probed in them
+    double missFraction = 0;          // share of sampled lookups and inserts that missed in the table
+    double observedHitProbes = 0;     // mean probe length of sampled hits under the previous table's policy
+    double observedMissProbes = 0;    // the same for misses
+    double predictedCost[3] = {0, 0, 0}; // expected memory accesses per operation, by prob_t
+};
+// counters describing how the table has been used
+struct VacDBStats{
+    long oldProbesSkipped = 0;  // old table probes avoided since the key's probe chain was already transferred
+    long filterNegatives = 0;   // probes answered "definitely absent" by a negative-lookup filter
+    long filterFalsePositives = 0; // probes a filter let through that found nothing
+    // observed false-positive rate is filterFalsePositives / (filterFalsePositives + filterNegatives)
+    double filterExpectedFalsePositiveRate = 0; // for the current table's filter at its present size
+    size_t filterBytes = 0;     // memory used by the filters of both tables
+    page_t tablePages = STANDARDPAGES; // pages actually backing the current slot array
+    long probingDecisions = 0;  // rehashes whose policy was chosen adaptively
+    long parallelRehashes = 0;  // completed rehashNow() calls
+    long parallelDeferred = 0;  // patients the last rehashNow() placed in its sequential pass
+    long chainAlarms = 0;       // placements that took more than chainLimit probe steps or found no free slot
+    long reseeds = 0;           // tables the chain guard rebuilt under a fresh hash seed
+    long policyFallbacks = 0;   // times the guard switched the next policy to DOUBLEHASH after a seed failed
+    long guardGrowths = 0;      // tables the guard rebuilt larger (and DOUBLEHASH) after no seed helped
+    long chainLimitRaises = 0;  // times the guard gave up on the keys and doubled its limit instead
+    int  chainLimit = 0;        // probe steps above which a placement sets off the guard
+    int  longestChain = 0;      // longest probe sequence used to place a patient in the current table
+    unsigned int hashSeed = 0;  // seed of the table hash, 0 while the hash function passed in places the patients
+    ProbingDecision lastProbingDecision;
+};
+// when the tiered mode moves patients out of memory
+struct TieringPolicy{
+    int    maxHotEntries = 0;     // demote once the hot table holds more live patients (0: only on request)
+    double demoteFraction = 0.25; // share of the hot patients demoted at a time
+};
+// state of the tiered mode
+struct TierStats{
+    long   hotEntries = 0;        // live patients in the in-memory table
+    long   coldEntries = 0;       // live patients in the segment files
+    size_t coldFileBytes = 0;
+    int    coldRuns = 0;          // segment files a cold lookup may have to search
+    size_t coldMemoryBytes = 0;   // memory the cold tier still takes (filter and deleted flags)
+    size_t memorySavedBytes = 0;  // estimated memory the cold patients would need in the table, less coldMemoryBytes
+    long   coldHits = 0;          // lookups answered by the segment
+    long   coldMisses = 0;        // lookups that searched the segment in vain (the filter answers most misses)
+    long   demotions = 0;
+    long   demotedPatients = 0;
+    long   mergedPatients = 0;    // patients rewritten when runs were merged
+};
+// outcome of an online checkpoint
+struct CheckpointStats{
+    bool   success = false;
+    size_t bytes = 0;               // size of the checkpoint file
+    double pauseSeconds = 0;        // time the caller was stopped to take the snapshot (the fork)
+    double seconds = 0;             // time from the snapshot to the finished file
+    double megabytesPerSecond = 0;  // bytes / seconds
+};
+// successful modifications reported to a ChangeListener
+enum change_t {CHANGEINSERT, CHANGEREMOVE, CHANGEUPDATE};
 class Grader;
 class Tester;
 class VacDB;
+class Patient;
+// receives every successful insert, remove and updateSerialNumber of a VacDB, in order
+// (see VacDB::setChangeListener and replication.h)
+class ChangeListener{
+public:
+    virtual ~ChangeListener() = default;
+    // newSerial is only set for CHANGEUPDATE, whose patient carries the old serial
+    virtual void changed(change_t change, const Patient& patient, int newSerial) = 0;
+};
 class Patient{
 public:
     friend class Tester;
     friend class Grader;
     friend class VacDB;
+    friend class VacDBCombiner;
     Patient(string name="", int serial=0, bool used=false){
-        m_name = name; m_serial = serial; m_used = used;
+        m_name = name; m_serial = serial; m_used = used; m_lastUse = 0;
     }
     string getKey() const {return m_name;}
     int getSerial() const {return m_serial;}
@@ -49,11 +151,37 @@ private:
     // if it is set to false, it means the bucket in the hash table is free for insert
     // if it is set to true, it means the bucket contains live data, and we cannot overwrite it
     bool m_used;
+    // recency stamp of the tiered mode (see VacDB::enableTiering), fits in the padding after m_used
+    uint16_t m_lastUse;
 };
 class VacDB{
 public:
     friend class Grader;
     friend class Tester;
+    friend class SharedVacDB;
+    friend class VacDBCombiner;
+    friend class ReplicationPrimary;
+
+    // forward iterator over the live patients of both tables
+    // every live patient is visited exactly once, even during an incremental rehash,
+    // since a transferred patient is soft-deleted in the old table
+    // the iterator is invalidated by any insert, remove or rehash
+    class const_iterator{
+    public:
+        const Patient& operator*() const {return *slot();}
+        const Patient* operator->() const {return slot();}
+        const_iterator& operator++() {m_index++; advance(); return *this;}
+        bool operator==(const const_iterator& rhs) const {return m_index == rhs.m_index;}
+        bool operator!=(const const_iterator& rhs) const {return m_index != rhs.m_index;}
+    private:
+        friend class VacDB;
+        const_iterator(const VacDB* db, int index) : m_db(db), m_index(index) {advance();}
+        // m_index runs over the current table slots followed by the old table slots
+        Patient* slot() const {return m_db->slotAt(m_index);}
+        void advance();
+        const VacDB* m_db;
+        int m_index;
+    };
     VacDB(int size, hash_fn hash, prob_t probing);
     ~VacDB();
     // Returns Load factor of the new table
@@ -61,16 +189,129 @@ public:
     // Returns the ratio of deleted slots in the new table
     float deletedRatio() const;
     // insert only happens in the new table
+    // the patient is stored live, whatever its used flag
+    // a placement far longer than the table should need (see getStats().chainLimit) makes the call
+    // rebuild both tables under a fresh hash seed, so that no set of names keeps every later
+    // insert, remove and getPatient() walking long probe sequences
     bool insert(Patient patient);
+    // inserts the patients as insert() would, but grows the table once for all of them and places
+    // them in the order of their home slots (runs of MINBULKINSERT or more); returns how many were inserted
+    int insertBulk(const vector<Patient>& patients);
     // remove can happen from either table
     bool remove(Patient patient);
     // find can happen in either table
+    // any number of threads may call it at once while no thread modifies the table (under a shared lock,
+    // say); after enableConcurrentReaders() it may also run alongside one writer
     const Patient getPatient(string name, int serial) const;
+    // reports every later successful insert, remove and updateSerialNumber() to listener (nullptr stops);
+    // demotions, rehashes and loadCheckpoint() change no patient and are not reported
+    void setChangeListener(ChangeListener* listener) {m_changes = listener;}
     // update the information
+    // the patient is re-keyed: it is inserted under the new serial number and removed under the old one,
+    // so it is found by the new key only; a patient of the cold tier moves back into memory
+    // returns false if the patient is absent, the serial number is invalid or already taken for the name
     bool updateSerialNumber(Patient patient, int serial);
+    // explicitly chosen policy for the next rehash; turns adaptive probing off
     void changeProbPolicy(prob_t policy);
+    // samples probe lengths and the hit/miss mix of getPatient() and insert(), and at every
+    // rehash picks the policy with the lowest expected cost for the new table by placing the
+    // live keys under each policy (see getStats().lastProbingDecision); the replay costs
+    // one hash per live patient when the rehash starts
+    // lookups of concurrent readers are not sampled
+    void setAdaptiveProbing(bool enabled);
+    bool adaptiveProbing() const {return m_adaptiveProbing;}
+    // the chain guard draws its hash seeds from random_device, so that the placement of the names
+    // cannot be worked out in advance; deterministic seeds follow a fixed sequence instead, so that
+    // replaying a trace (see workload.h) builds the same tables every time
+    void setDeterministicSeeds(bool deterministic) {m_deterministicSeeds = deterministic;}
+    // sets the resize policy used while the table is probed with the given policy,
+    // or for every policy; returns false if the thresholds would make the table
+    // resize again right after a rehash (shrink < 1/growthFactor < grow must hold)
+    bool setResizePolicy(const ResizePolicy& policy, prob_t probing);
+    bool setResizePolicy(const ResizePolicy& policy);
+    ResizePolicy getResizePolicy(prob_t probing) const;
+    // finishes any rehash in progress and makes room for numEntries live patients without further growth
+    void reserve(int numEntries);
+    // rebuilds both tables at once into a new table sized for the live patients (as a rehash would),
+    // using the policy set by changeProbPolicy(); numThreads workers each place the patients whose home
+    // slot lies in their own range of the new table, the few whose probe sequence leaves that range
+    // are placed afterwards by the caller; numThreads <= 0 uses all hardware threads
+    // returns false, changing nothing, if the memory budget does not allow the new table
+    // or a probe sequence of the QUADRATIC policy finds no free slot in it
+    bool rehashNow(int numThreads = 0);
+    // approximate number of bytes used by the slot arrays and entries of both tables
+    size_t footprint() const;
+    // page size and NUMA placement of the slot arrays; the tables in use are moved
+    // into new arrays right away, later rehashes allocate with the same policy
+    void setAllocationPolicy(const AllocationPolicy& policy);
+    AllocationPolicy getAllocationPolicy() const {return m_allocPolicy;}
+    VacDBStats getStats() const;
+    bool rehashInProgress() const {return m_transferIndex != -1;}
+    // single-writer / many-reader mode: getPatient() no longer takes any lock and may run
+    // concurrently with one thread calling the modifying functions; patients and tables
+    // unlinked by the writer are freed through epoch-based reclamation
+    // every other function remains writer-side only
+    void enableConcurrentReaders();
+    bool concurrentReaders() const {return m_epochs != nullptr;}
+    // keeps a Bloom filter of bitsPerEntry bits per entry in front of each table so that most
+    // lookups of absent patients (and the duplicate check of insert) touch no slot at all
+    void enableNegativeFilter(int bitsPerEntry = 10);
+    // takes a point-in-time image of both tables, including a rehash in progress, and writes it to path
+    // in a forked child process; insert and remove keep running here while the copy-on-write child writes
+    // returns false if the snapshot could not be taken or another checkpoint is still running
+    bool startCheckpoint(const string& path);
+    bool checkpointInProgress() const {return m_checkpointPid > 0;}
+    // waits for the running checkpoint and reports how it went
+    CheckpointStats finishCheckpoint();
+    // replaces the contents with a checkpoint; the object must use the same hash function as the writer
+    // (the hash seed chosen by the chain guard is part of the checkpoint)
+    // returns false, changing nothing, if the file is inconsistent: counts or the transfer index out of
+    // range, serial numbers outside MINID..MAXID, a live patient its table could not find, or a live
+    // patient in the old table below the transfer index; the table sizes are counted from the entries
+    bool loadCheckpoint(const string& path);
+    // tiered mode: the least recently used patients are moved to sorted segment files path.<n>
+    // that are memory-mapped (see ColdTier for the cost of a demotion), and getPatient(), insert()
+    // and remove() fall through to them;
+    // iteration, the parallel reports and checkpoints only cover the patients in memory
+    // returns false if tiering is already on
+    bool enableTiering(const string& path, const TieringPolicy& policy = TieringPolicy());
+    bool tiering() const {return !m_coldPath.empty();}
+    // moves the count least recently used patients to a new run of the cold tier, returns how many were moved
+    int demoteColdest(int count);
+    TierStats getTierStats() const;
+    // number of live patients in both tables and the cold tier
+    long numPatients() const {return m_numPatients;}
+    // keeps the number of live patients per name and per serial number up to date on every insert,
+    // remove and updateSerialNumber(), so that the reports below answer without a scan
+    // the counts are writer-side only, like the modifying functions
+    void enableAggregates();
+    bool aggregates() const {return m_aggregates;}
+    // live patients with the given name or serial number, -1 if aggregates are off
+    int countOfName(const string& name) const;
+    int countOfSerial(int serial) const;
+    int numNames() const {return m_aggregates ? int(m_nameCounts.size()) : -1;}
+    // live patients per serial number, indexed by serial - MINID (empty if aggregates are off)
+    const vector<int>& serialHistogram() const {return m_serialCounts;}
     void dump() const;
 
+    const_iterator begin() const {return const_iterator(this, 0);}
+    const_iterator end() const {return const_iterator(this, numSlots());}
+    // calls visit once for every live patient, splitting the slots of both tables across threads
+    // visit runs concurrently and must be thread-safe; numThreads <= 0 uses all hardware threads
+    void parallelForEach(const function<void(const Patient&)>& visit, int numThreads = 0) const;
+    // every thread folds its share of the live patients into its own copy of identity,
+    // the partial results are then combined with merge(result, partial)
+    template <typename T, typename Accumulate, typename Merge>
+    T parallelReduce(const T& identity, Accumulate accumulate, Merge merge, int numThreads = 0) const;
+    // number of live patients per name and per vaccine serial number
+    map<string, int> countByName(int numThreads = 0) const;
+    map<int, int> countBySerial(int numThreads = 0) const;
+    // streams the live patients of both tables and of the cold tier that the filters of options select
+    // to sink (see export.h); slot partitions are formatted in parallel and handed to sink in slot order,
+    // so the output does not depend on the number of threads
+    // like parallelForEach() it must not run concurrently with the modifying functions
+    ExportStats exportPatients(const ExportSink& sink, const ExportOptions& options = ExportOptions()) const;
+
 private:
     hash_fn    m_hash;          // hash function
     prob_t     m_newPolicy;     // stores the change of policy request
@@ -92,14 +333,235 @@ private:
     int        m_transferIndex; // this can be used as a temporary place holder
     // during incremental transfer to scanning the table
 
-    //private helper functions
-    bool isPrime(int number);
-    int findNextPrime(int current);
+    ResizePolicy m_resizePolicy[3]; // resize policy for each probing policy (indexed by prob_t)
+    int        m_currMaxProbe;  // longest probe sequence used to place an entry in the current table
+    int        m_oldMaxProbe;   // the same for the old table, frozen when the rehash starts
+    // chain guard: a placement longer than chainLimit() raises the alarm, and the end of the insert or
+    // remove rebuilds the tables under a fresh seed (see guardChains)
+    unsigned int m_hashSeed;    // 0 hashes with m_hash, shared by both tables
+    double     m_chainSlack;    // chainLimit() in multiples of the expected longest chain
+    bool       m_chainAlarm;
+    bool       m_guardGaveUp;   // no rebuild helped, the guard rests until a table is built otherwise
+    bool       m_deterministicSeeds;
+    VacDBStats m_stats;
+    // counters of the lookup path; getPatient() is const and may run in several threads at once under
+    // a shared lock, so these are relaxed atomics that getStats() and getTierStats() copy out
+    struct LookupCounters{
+        atomic<long> oldProbesSkipped{0};
+        atomic<long> filterNegatives{0};
+        atomic<long> filterFalsePositives{0};
+        atomic<long> coldHits{0};
+        atomic<long> coldMisses{0};
+    };
+    mutable LookupCounters m_lookups;
+    AllocationPolicy m_allocPolicy; // how slot arrays are allocated
+
+    bool         m_adaptiveProbing;     // m_newPolicy is chosen at every rehash
+    // the samples are taken by const lookups as well, hence atomic like m_lookups
+    mutable atomic<unsigned int> m_sampleTick;  // operations since the last sample
+    mutable atomic<long> m_sampledHits, m_sampledMisses;  // since the last rehash
+    mutable atomic<long> m_sampledHitProbes, m_sampledMissProbes;
+    // reservoir of MISSSAMPLES hashes of sampled absent keys, reused as misses in the simulation
+    // (allocated when adaptive probing is first turned on)
+    unique_ptr<atomic<unsigned int>[]> m_missHashes;
+
+    string        m_coldPath;           // segment file of the tiered mode, empty if it is off
+    TieringPolicy m_tiering;
+    ColdTier*     m_cold;               // nullptr until the first demotion
+    mutable atomic<uint32_t> m_useClock; // operations counted for recency stamps
+    TierStats m_tierStats;
+
+    long       m_numPatients;       // live patients, unlike m_currentSize
+    bool       m_aggregates;
+    unordered_map<string, int> m_nameCounts; // names of live patients only
+    vector<int> m_serialCounts;     // indexed by serial - MINID
+
+    ChangeListener* m_changes;      // nullptr unless someone listens
+    bool       m_batching;          // a combiner batch is running (see VacDBCombiner)
+    long       m_batchedTransfers;  // transfer steps deferred to the end of the batch
+
+    int          m_filterBits;      // bits per entry of the negative-lookup filters, 0 if disabled
+    BloomFilter* m_currentFilter;   // filter of the current table
+    BloomFilter* m_oldFilter;       // filter of the old table
+
+    int        m_checkpointPid;     // child writing a checkpoint, 0 if none
+    string     m_checkpointPath;    // final and temporary file of that checkpoint
+    string     m_checkpointTempPath;
+    double     m_checkpointPause;
+    chrono::steady_clock::time_point m_checkpointStart;
+
+    // immutable description of both tables published to lock-free readers
+    struct ReadView{
+        Patient**  m_currentTable;
+        int        m_currentCap;
+        prob_t     m_currProbing;
+        Patient**  m_oldTable;
+        int        m_oldCap;
+        prob_t     m_oldProbing;
+        const BloomFilter* m_currentFilter;
+        const BloomFilter* m_oldFilter;
+        const ColdTier* m_cold;
+        unsigned int m_hashSeed;
+    };
+    unique_ptr<EpochManager> m_epochs;  // only set in concurrent reader mode
+    atomic<ReadView*> m_readView;       // replaced whenever the tables are swapped
+
+    //private helper functions (static, so that SharedVacDB sizes its tables the same way)
+    static bool isPrime(int number);
+    static int findNextPrime(int current);
 
     /******************************************
     * Private function declarations go here! *
     ******************************************/
-    bool probe(unsigned int& index, string key, int serial, bool isCurrentTable) const;
+    // stores a new copy of patient at index of the current table, which probe() returned for it
+    void placePatient(unsigned int index, const Patient& patient, int probeLength);
+    // callers placing a patient at index pass probeLength, which receives the number of probe steps
+    // taken to reach index; without it a miss answered by the filter leaves index unset
+    // a lookup walks at most m_currMaxProbe (or m_oldMaxProbe) steps, and index only points to a
+    // live patient if the current table has no free slot on the probe sequence
+    bool probe(unsigned int& index, string key, int serial, bool isCurrentTable, int* probeLength = nullptr) const;
+    // probes one table for a key with the given hashOf() value, returns the live patient matching
+    // key and serial or nullptr
+    // reuseDeleted makes index point to the first soft-deleted slot on the way when there is no match
+    // maxProbe stops the walk after that many steps (-1 walks until an empty slot, or capacity steps)
+    Patient* findSlot(unsigned int& index, const string& key, int serial, unsigned int hash,
+                      Patient** hashTable, int capacity, prob_t probingPolicy, bool reuseDeleted,
+                      int* probeLength = nullptr, int maxProbe = -1) const;
+    // first empty or soft-deleted slot of the probe sequence, used when the key is known to be absent
+    // gives up after capacity steps, leaving index at a live patient
+    unsigned int findFreeSlot(unsigned int hash, Patient** hashTable, int capacity, prob_t probingPolicy,
+                              int* probeLength) const;
+    // where a patient goes in the tables: m_hash of the name while seed is 0, otherwise a seeded hash
+    // of name and serial, so that keys colliding under m_hash spread out again
+    // the cold tier is ordered by m_hash and does not depend on the seed
+    unsigned int hashOf(const string& key, int serial, unsigned int seed) const;
+    // probe steps above which a chain is taken as a sign of pathological keys
+    int chainLimit() const {return chainLimit(m_chainSlack);}
+    int chainLimit(double slack) const;
+    // raises the alarm for a placement of probeLength steps if it is above chainLimit()
+    void checkChain(int probeLength) {
+        if (probeLength > MINCHAINLIMIT && probeLength > chainLimit()) {
+            m_chainAlarm = true;
+            m_stats.chainAlarms++;
+        }
+    }
+    // answers the alarm: rebuilds both tables under fresh seeds (falling back to DOUBLEHASH after the first)
+    // until the longest chain is below the limit; after MAXRESEEDS attempts it builds a larger DOUBLEHASH
+    // table, and if that fails too (the memory budget), raises the limit and rests until the next table
+    void guardChains();
+    // a fresh seed other than m_hashSeed and 0, see setDeterministicSeeds()
+    unsigned int nextSeed() const;
+    // called whenever a new table is complete: one whose chains fit CHAINSLACK resets the guard
+    void tableBuilt();
+    // rehashNow() under the given seed; reseeding keeps m_newPolicy and, unless the live patients are
+    // above its grow threshold, the capacity of the current table; newCap overrides the capacity
+    // returns false, changing nothing, if a QUADRATIC sequence finds no slot or the new table would
+    // not fit the memory budget next to the present ones
+    bool rebuildTable(int numThreads, unsigned int seed, bool reseeding, int newCap = 0);
+    // true once every SAMPLEPERIOD operations while adaptive probing is on
+    bool sampleNow() const {
+        return m_adaptiveProbing && m_sampleTick.fetch_add(1, memory_order_relaxed) % SAMPLEPERIOD == SAMPLEPERIOD - 1;
+    }
+    void sampleProbe(const string& key, int serial, bool found, int probeLength) const;
+    // the policy expected to be cheapest for a table of newCap slots holding the live patients
+    prob_t chooseProbing(int newCap);
+    // records a use of patient for the tiered mode; lookups under a shared lock may stamp the same patient
+    void touch(Patient* patient) const {
+        if (!m_coldPath.empty()) {
+            uint32_t now = m_useClock.fetch_add(1, memory_order_relaxed) + 1;
+            __atomic_store_n(&patient->m_lastUse, uint16_t(now >> RECENCYSHIFT), __ATOMIC_RELAXED);
+        }
+    }
+    // record index of a live cold patient, -1 if absent or tiering is off
+    long findCold(const ColdTier* cold, const string& name, int serial) const;
+    void retireTier(ColdTier* tier);
+    // adds delta to the aggregates of a patient
+    void countPatient(const string& name, int serial, int delta);
+    // recomputes m_numPatients and the aggregates from the tables and the cold tier
+    void recount();
+    // filter for a table of the given capacity, nullptr if filters are disabled
+    BloomFilter* newFilter(int capacity) const;
+    // replaces both filters by ones holding the live patients of their tables
+    void rebuildFilters();
+    // writes the checkpoint image to fd without allocating memory (runs in the forked child)
+    bool writeCheckpoint(int fd) const;
+    // the index visited after index at step i of the probe sequence of a key with the given hash
+    static unsigned int nextIndex(unsigned int index, int i, unsigned int hash, int capacity, prob_t probingPolicy);
+    // true if every old table slot where a key with the given hash could live has already been
+    // transferred, i.e. the first m_oldMaxProbe + 1 positions of its probe sequence lie below m_transferIndex
+    bool oldChainTransferred(unsigned int hash) const;
+    const Patient getPatientConcurrent(const string& name, int serial) const;
+    // publishes the current table layout to readers, called after every table swap
+    void publishView();
+    // frees a patient or table array right away, or once no reader can see it any more
+    void retirePatient(Patient* patient);
+    void retireTable(Patient** table, int capacity);
+    void retireFilter(BloomFilter* filter);
+    // slots and the m_used flags are accessed atomically so that a concurrent reader
+    // never sees a patient before it is fully constructed
+    static Patient* loadSlot(Patient* const* slot) {return __atomic_load_n(slot, __ATOMIC_ACQUIRE);}
+    static void storeSlot(Patient** slot, Patient* patient) {__atomic_store_n(slot, patient, __ATOMIC_RELEASE);}
+    static bool isLive(const Patient* patient) {return __atomic_load_n(&patient->m_used, __ATOMIC_ACQUIRE);}
+    static void markDeleted(Patient* patient) {__atomic_store_n(&patient->m_used, false, __ATOMIC_RELEASE);}
     void rehash();
+    // the rehash step after an insert or remove; in a batch, steps of a transfer in progress only
+    // count towards endBatch(), while a new rehash still starts at once
+    void rehashStep() {
+        if (m_batching && m_transferIndex != -1) m_batchedTransfers++;
+        else rehash();
+    }
+    void beginBatch();
+    // runs the deferred transfer steps, returns how many
+    long endBatch();
+    // moves the current table to the old table and starts an incremental transfer into a table of newCap slots
+    void beginRehash(int newCap);
+    // capacity of the next table for the given number of live entries, 0 if the memory budget does not allow it
+    int nextCapacity(int numLive);
+    int numLive() const {return m_currentSize - m_currNumDeleted;}
+    // live patients in memory, in either table (what TieringPolicy::maxHotEntries limits)
+    long hotEntries() const {return m_numPatients - (m_cold != nullptr ? m_cold->numLive() : 0);}
+    // slots are numbered over the current table followed by the old table
+    int numSlots() const {return m_currentCap + m_oldCap;}
+    Patient* slotAt(int slot) const;
+    int numWorkers(int numThreads) const;
+    // calls visit(patient) for every live patient in the slot range [first, last)
+    template <typename Visit>
+    void scanSlots(int first, int last, Visit visit) const;
 };
+
+template <typename Visit>
+void VacDB::scanSlots(int first, int last, Visit visit) const {
+    for (int i = first; i < last; i++) {
+        Patient* patient = slotAt(i);
+        if (patient != nullptr && patient->getUsed()) {
+            visit(*patient);
+        }
+    }
+}
+
+template <typename T, typename Accumulate, typename Merge>
+T VacDB::parallelReduce(const T& identity, Accumulate accumulate, Merge merge, int numThreads) const {
+    int workers = numWorkers(numThreads);
+    int chunk = (numSlots() + workers - 1) / workers;
+    vector<T> partials(workers, identity);
+    vector<thread> threads;
+
+    //each worker reduces a contiguous slot range into its own partial result
+    for (int w = 0; w < workers; w++) {
+        threads.emplace_back([&, w]() {
+            int first = w * chunk;
+            int last = min(first + chunk, numSlots());
+            scanSlots(first, last, [&](const Patient& patient) { accumulate(partials[w], patient); });
+        });
+    }
+    for (thread& worker : threads) {
+        worker.join();
+    }
+
+    T result = identity;
+    for (T& partial : partials) {
+        merge(result, partial);
+    }
+    return result;
+}
 #endif
\ No newline at end of file
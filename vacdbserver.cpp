@@ -0,0 +1,80 @@
+// CMSC 341 - Spring 2024 - Project 4
+// Standalone VacDB server, run as:
+//   VacDBServer [--unix path] [--tcp port] [--policy quadratic|doublehash|linear] [--size n]
+//                [--record trace]
+// without a listening option it serves /tmp/vacdb.sock
+#include "server.h"
+#include <csignal>
+#include <cstdlib>
+
+unsigned int hashCode(const string str);
+
+VacDBServer *runningServer = nullptr;
+
+void stopServer(int) {
+    if (runningServer != nullptr) {
+        runningServer->stop();
+    }
+}
+
+int main(int argc, char **argv) {
+    string unixPath;
+    int tcpPort = 0;
+    prob_t policy = DEFPOLCY;
+    int size = MINPRIME;
+    string tracePath;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--unix") {
+            unixPath = value;
+        } else if (option == "--tcp") {
+            tcpPort = atoi(value.c_str());
+        } else if (option == "--size") {
+            size = atoi(value.c_str());
+        } else if (option == "--record") {
+            tracePath = value;
+        } else if (option == "--policy") {
+            policy = value == "linear" ? LINEAR : value == "doublehash" ? DOUBLEHASH : QUADRATIC;
+        } else {
+            cerr << "unknown option " << option << endl;
+            return 1;
+        }
+    }
+    if (unixPath.empty() && tcpPort == 0) {
+        unixPath = "/tmp/vacdb.sock";
+    }
+
+    VacDB vacdb(size, hashCode, policy);
+    VacDBServer server(vacdb);
+    if ((!unixPath.empty() && !server.listenUnix(unixPath)) || (tcpPort != 0 && !server.listenTcp(tcpPort))) {
+        cerr << "cannot listen" << endl;
+        return 1;
+    }
+
+    if (!tracePath.empty() && !server.recordTrace(tracePath)) {
+        cerr << "cannot record to " << tracePath << endl;
+        return 1;
+    }
+
+    runningServer = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    signal(SIGPIPE, SIG_IGN);
+    if (!unixPath.empty()) cout << "listening on " << unixPath << endl;
+    if (tcpPort != 0) cout << "listening on 127.0.0.1:" << tcpPort << endl;
+
+    bool ok = server.run();
+    server.stopRecording();
+    cout << server.requestsServed() << " requests served" << endl;
+    return ok ? 0 : 1;
+}
+
+unsigned int hashCode(const string str) {
+    unsigned int val = 0;
+    const unsigned int thirtyThree = 33;  // magic number from textbook
+    for (unsigned int i = 0; i < str.length(); i++)
+        val = val * thirtyThree + str[i];
+    return val;
+}
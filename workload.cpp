@@ -0,0 +1,263 @@
+// CMSC 341 - Spring 2024 - Project 4
+#include "workload.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+static const char TRACEMAGIC[8] = {'V', 'A', 'C', 'D', 'B', 'T', 'R', '2'};
+static const size_t TRACEBUFFER = 1 << 16;
+static const uint64_t MAXTRACENAME = 1 << 24;  // longer names are not recorded, and read as malformed
+
+static double zeta(int n, double theta) {
+    double sum = 0;
+    for (int i = 1; i <= n; i++) {
+        sum += 1.0 / pow(double(i), theta);
+    }
+    return sum;
+}
+
+ZipfianGenerator::ZipfianGenerator(int n, double theta) : m_uniform(0.0, 1.0) {
+    m_n = max(n, 1);
+    //theta of exactly 1 divides by zero below
+    m_theta = min(max(theta, 0.01), 0.999);
+    m_alpha = 1.0 / (1.0 - m_theta);
+    m_zetan = zeta(m_n, m_theta);
+    m_eta = (1.0 - pow(2.0 / m_n, 1.0 - m_theta)) / (1.0 - zeta(min(m_n, 2), m_theta) / m_zetan);
+}
+
+int ZipfianGenerator::next(mt19937_64 &generator) {
+    double u = m_uniform(generator);
+    double uz = u * m_zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, m_theta)) {
+        return min(1, m_n - 1);
+    }
+    int rank = int(m_n * pow(m_eta * u - m_eta + 1.0, m_alpha));
+    return min(max(rank, 0), m_n - 1);
+}
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadSpec &spec)
+        : m_spec(spec), m_generator(spec.seed),
+          m_zipf(spec.distribution == ZIPFIANKEYS ? max(spec.numKeys, 1) : 1, spec.zipfTheta),
+          m_opMix({spec.insertWeight, spec.getWeight, spec.removeWeight, spec.updateWeight}),
+          m_uniform(0.0, 1.0), m_arrivals(spec.opsPerSecond > 0 ? spec.opsPerSecond : 1.0) {
+    m_spec.numKeys = max(m_spec.numKeys, 1);
+    //the key space is derived from the seed alone so that independent generators agree
+    mt19937 keyGenerator(spec.seed);
+    uniform_int_distribution<> letter('a', 'z');
+    uniform_int_distribution<> serial(MINID, MAXID);
+    m_keys.reserve(m_spec.numKeys);
+    for (int i = 0; i < m_spec.numKeys; i++) {
+        string name(max(m_spec.nameLength, 1), ' ');
+        for (char &c: name) {
+            c = char(letter(keyGenerator));
+        }
+        m_keys.push_back(Patient(name, serial(keyGenerator), true));
+    }
+    //popularity rank i is key i; the names are random, so hot keys still spread over the table
+}
+
+int WorkloadGenerator::nextKey() {
+    int n = m_spec.numKeys;
+    switch (m_spec.distribution) {
+        case ZIPFIANKEYS:
+            return m_zipf.next(m_generator);
+        case HOTSETKEYS: {
+            int hotKeys = min(max(int(n * m_spec.hotKeyFraction), 1), n);
+            if (hotKeys == n || m_uniform(m_generator) < m_spec.hotOpFraction) {
+                return int(m_generator() % hotKeys);
+            }
+            return hotKeys + int(m_generator() % (n - hotKeys));
+        }
+        default:
+            return int(m_generator() % n);
+    }
+}
+
+TraceRecord WorkloadGenerator::next() {
+    TraceRecord record;
+    record.op = trace_op_t(m_opMix(m_generator));
+    record.patient = m_keys[nextKey()];
+    if (record.op == TRACE_UPDATE) {
+        record.newSerial = MINID + int(m_generator() % (MAXID - MINID + 1));
+    }
+    if (m_spec.opsPerSecond > 0) {
+        record.delayMicros = uint64_t(llround(m_arrivals(m_generator) * 1e6));
+    }
+    return record;
+}
+
+bool TraceWriter::open(const string &path) {
+    m_out.open(path, ios::binary | ios::trunc);
+    if (!m_out) {
+        return false;
+    }
+    m_buffer.clear();
+    m_buffer.reserve(TRACEBUFFER);
+    m_buffer.append(TRACEMAGIC, sizeof(TRACEMAGIC));
+    m_count = 0;
+    m_started = false;
+    return true;
+}
+
+void TraceWriter::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        m_buffer.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    m_buffer.push_back(char(value));
+}
+
+static uint64_t zigzag(int value) {
+    return (uint64_t(uint32_t(value)) << 1) ^ uint64_t(int64_t(value >> 31));
+}
+
+static int unzigzag(uint64_t value) {
+    return int(uint32_t(value >> 1) ^ -uint32_t(value & 1));
+}
+
+bool TraceWriter::write(const TraceRecord &record) {
+    if (!m_out.is_open()) {
+        return false;
+    }
+    const string &name = record.patient.getKey();
+    if (name.size() > MAXTRACENAME) {
+        return false;
+    }
+    m_buffer.push_back(char(record.op));
+    putVarint(record.delayMicros);
+    putVarint(name.size());
+    m_buffer.append(name);
+    putVarint(zigzag(record.patient.getSerial()));
+    if (record.op == TRACE_UPDATE) {
+        putVarint(zigzag(record.newSerial));
+    }
+    m_count++;
+    if (m_buffer.size() >= TRACEBUFFER) {
+        m_out.write(m_buffer.data(), streamsize(m_buffer.size()));
+        m_buffer.clear();
+    }
+    return bool(m_out);
+}
+
+bool TraceWriter::record(trace_op_t op, const Patient &patient, int newSerial) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    TraceRecord record;
+    record.op = op;
+    record.patient = patient;
+    record.newSerial = newSerial;
+    if (m_started) {
+        record.delayMicros = uint64_t(chrono::duration_cast<chrono::microseconds>(now - m_last).count());
+    }
+    m_started = true;
+    m_last = now;
+    return write(record);
+}
+
+bool TraceWriter::close() {
+    if (!m_out.is_open()) {
+        return false;
+    }
+    m_out.write(m_buffer.data(), streamsize(m_buffer.size()));
+    m_buffer.clear();
+    bool success = bool(m_out);
+    m_out.close();
+    return success;
+}
+
+bool TraceReader::open(const string &path) {
+    m_in.open(path, ios::binary);
+    char magic[sizeof(TRACEMAGIC)];
+    return m_in.read(magic, sizeof(magic)) && memcmp(magic, TRACEMAGIC, sizeof(magic)) == 0;
+}
+
+bool TraceReader::getVarint(uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = m_in.get();
+        if (byte == EOF) {
+            return false;
+        }
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::next(TraceRecord &record) {
+    int op = m_in.get();
+    if (op == EOF || op > TRACE_UPDATE) {
+        return false;
+    }
+    uint64_t nameLength = 0, serial = 0, newSerial = 0;
+    if (!getVarint(record.delayMicros) || !getVarint(nameLength) || nameLength > MAXTRACENAME) {
+        return false;
+    }
+    string name(nameLength, ' ');
+    if (!m_in.read(&name[0], nameLength) || !getVarint(serial)) {
+        return false;
+    }
+    if (op == TRACE_UPDATE && !getVarint(newSerial)) {
+        return false;
+    }
+    record.op = trace_op_t(op);
+    record.patient = Patient(name, unzigzag(serial), true);
+    record.newSerial = unzigzag(newSerial);
+    return true;
+}
+
+bool applyRecord(VacDB &vacdb, const TraceRecord &record) {
+    switch (record.op) {
+        case TRACE_INSERT:
+            return vacdb.insert(record.patient);
+        case TRACE_REMOVE:
+            return vacdb.remove(record.patient);
+        case TRACE_UPDATE:
+            return vacdb.updateSerialNumber(record.patient, record.newSerial);
+        default:
+            return !vacdb.getPatient(record.patient.getKey(), record.patient.getSerial()).getKey().empty();
+    }
+}
+
+ReplayStats replayTrace(TraceReader &trace, VacDB &vacdb, double speedup, double opsPerSecond) {
+    ReplayStats stats;
+    vector<double> latencies;
+    TraceRecord record;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double recordedMicros = 0;
+    long issued = 0;
+    while (trace.next(record)) {
+        //hold each operation back until its scheduled time, never ahead of it
+        recordedMicros += double(record.delayMicros);
+        double dueMicros = -1;
+        if (speedup > 0) {
+            dueMicros = recordedMicros / speedup;
+        } else if (opsPerSecond > 0) {
+            dueMicros = issued * 1e6 / opsPerSecond;
+        }
+        if (dueMicros > 0) {
+            this_thread::sleep_until(start + chrono::microseconds(llround(dueMicros)));
+        }
+        chrono::steady_clock::time_point before = chrono::steady_clock::now();
+        bool success = applyRecord(vacdb, record);
+        latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - before).count());
+        stats.ops[record.op]++;
+        stats.succeeded[record.op] += success;
+        issued++;
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!latencies.empty()) {
+        size_t p50 = latencies.size() / 2, p99 = min(latencies.size() - 1, latencies.size() * 99 / 100);
+        nth_element(latencies.begin(), latencies.begin() + p50, latencies.end());
+        stats.p50Micros = latencies[p50];
+        nth_element(latencies.begin(), latencies.begin() + p99, latencies.end());
+        stats.p99Micros = latencies[p99];
+        stats.maxMicros = *max_element(latencies.begin(), latencies.end());
+    }
+    return stats;
+}
@@ -0,0 +1,115 @@
+// CMSC 341 - Spring 2024 - Project 4
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "vacdb.h"
+using namespace std;
+// Synthetic workloads and operation traces for VacDB.
+//
+// Trace file layout: "VACDBTR2", then one record per operation:
+//   uint8 op, varint microseconds since the previous record,
+//   varint name length (at most 1 << 24), name bytes, zigzag varint serial,
+//   and for TRACE_UPDATE a zigzag varint new serial.
+enum trace_op_t : uint8_t {TRACE_INSERT, TRACE_GET, TRACE_REMOVE, TRACE_UPDATE};
+enum key_dist_t {UNIFORMKEYS, ZIPFIANKEYS, HOTSETKEYS};
+
+struct TraceRecord{
+    trace_op_t op = TRACE_GET;
+    uint64_t   delayMicros = 0;   // time since the previous operation
+    Patient    patient;
+    int        newSerial = 0;     // only used by TRACE_UPDATE
+};
+
+struct WorkloadSpec{
+    int    numKeys = 10000;       // distinct patients the operations pick from
+    int    nameLength = 10;
+    // operation mix, relative weights
+    double insertWeight = 0.2;
+    double getWeight = 0.7;
+    double removeWeight = 0.05;
+    double updateWeight = 0.05;
+    key_dist_t distribution = ZIPFIANKEYS;
+    double zipfTheta = 0.99;      // skew of the Zipfian distribution (0 < theta < 1)
+    double hotKeyFraction = 0.1;  // HOTSETKEYS: this share of the keys ...
+    double hotOpFraction = 0.9;   // ... receives this share of the operations
+    double opsPerSecond = 100000; // mean rate of the recorded timestamps (exponential arrivals)
+    unsigned int seed = 10;
+};
+
+// Zipfian ranks in [0, n) as in Gray et al., "Quickly generating billion-record
+// synthetic databases"; rank 0 is the most popular
+class ZipfianGenerator{
+public:
+    ZipfianGenerator(int n, double theta);
+    int next(mt19937_64& generator);
+private:
+    int m_n;
+    double m_theta, m_alpha, m_zetan, m_eta;
+    uniform_real_distribution<double> m_uniform;
+};
+
+class WorkloadGenerator{
+public:
+    explicit WorkloadGenerator(const WorkloadSpec& spec);
+    TraceRecord next();
+    // the patient behind key number key (the same for every generator with the same spec)
+    const Patient& keyPatient(int key) const {return m_keys[key];}
+private:
+    int nextKey();
+    WorkloadSpec m_spec;
+    vector<Patient> m_keys;
+    mt19937_64 m_generator;
+    ZipfianGenerator m_zipf;
+    discrete_distribution<int> m_opMix;
+    uniform_real_distribution<double> m_uniform;
+    exponential_distribution<double> m_arrivals;
+};
+
+class TraceWriter{
+public:
+    bool open(const string& path);
+    // writes a record with its own delay; false, writing nothing, for a name over 1 << 24 bytes
+    bool write(const TraceRecord& record);
+    // writes a record stamped with the time elapsed since the previous record() call
+    bool record(trace_op_t op, const Patient& patient, int newSerial = 0);
+    bool close();
+    long count() const {return m_count;}
+private:
+    void putVarint(uint64_t value);
+    ofstream m_out;
+    string m_buffer;
+    long m_count = 0;
+    bool m_started = false;
+    chrono::steady_clock::time_point m_last;
+};
+
+class TraceReader{
+public:
+    bool open(const string& path);
+    // false at the end of the trace or on a malformed record
+    bool next(TraceRecord& record);
+private:
+    bool getVarint(uint64_t& value);
+    ifstream m_in;
+};
+
+struct ReplayStats{
+    long ops[4] = {0, 0, 0, 0};        // operations per trace_op_t
+    long succeeded[4] = {0, 0, 0, 0};  // of which returned true (or found the patient)
+    double seconds = 0;
+    double p50Micros = 0, p99Micros = 0, maxMicros = 0;
+    long total() const {return ops[0] + ops[1] + ops[2] + ops[3];}
+};
+
+// applies every operation of the trace to vacdb; speedup > 0 keeps the recorded
+// timing compressed by that factor, opsPerSecond > 0 issues at a fixed rate,
+// otherwise operations run back to back
+ReplayStats replayTrace(TraceReader& trace, VacDB& vacdb, double speedup = 0, double opsPerSecond = 0);
+// applies one operation, returns whether it succeeded
+bool applyRecord(VacDB& vacdb, const TraceRecord& record);
+#endif
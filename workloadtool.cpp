@@ -0,0 +1,176 @@
+// CMSC 341 - Spring 2024 - Project 4
+// Generates and replays VacDB operation traces, run as:
+//   Workload generate <trace> [--ops n] [--keys n] [--mix insert,get,remove,update]
+//                     [--dist uniform|zipf|hotset] [--theta t] [--hot keys,ops] [--rate ops/s] [--seed s]
+//   Workload replay <trace> [--speedup x | --rate ops/s] [--policy quadratic|doublehash|linear] [--size n]
+//                   [--seeds random|fixed]
+//   Workload info <trace>
+// traces recorded by VacDBServer --record replay the same way
+#include "workload.h"
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+unsigned int hashCode(const string str);
+
+static const char *OPNAMES[] = {"insert", "get", "remove", "update"};
+
+vector<double> parseList(const string &value) {
+    vector<double> numbers;
+    stringstream stream(value);
+    string item;
+    while (getline(stream, item, ',')) {
+        numbers.push_back(atof(item.c_str()));
+    }
+    return numbers;
+}
+
+int generate(const string &path, int argc, char **argv) {
+    WorkloadSpec spec;
+    long ops = 100000;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--ops") {
+            ops = atol(value.c_str());
+        } else if (option == "--keys") {
+            spec.numKeys = atoi(value.c_str());
+        } else if (option == "--mix") {
+            vector<double> mix = parseList(value);
+            if (mix.size() != 4) {
+                cerr << "--mix needs four weights" << endl;
+                return 1;
+            }
+            spec.insertWeight = mix[0];
+            spec.getWeight = mix[1];
+            spec.removeWeight = mix[2];
+            spec.updateWeight = mix[3];
+        } else if (option == "--dist") {
+            spec.distribution = value == "uniform" ? UNIFORMKEYS : value == "hotset" ? HOTSETKEYS : ZIPFIANKEYS;
+        } else if (option == "--theta") {
+            spec.zipfTheta = atof(value.c_str());
+        } else if (option == "--hot") {
+            vector<double> hot = parseList(value);
+            if (hot.size() != 2) {
+                cerr << "--hot needs a key fraction and an operation fraction" << endl;
+                return 1;
+            }
+            spec.hotKeyFraction = hot[0];
+            spec.hotOpFraction = hot[1];
+        } else if (option == "--rate") {
+            spec.opsPerSecond = atof(value.c_str());
+        } else if (option == "--seed") {
+            spec.seed = (unsigned int) atol(value.c_str());
+        } else {
+            cerr << "unknown option " << option << endl;
+            return 1;
+        }
+    }
+
+    WorkloadGenerator generator(spec);
+    TraceWriter writer;
+    if (!writer.open(path)) {
+        cerr << "cannot write " << path << endl;
+        return 1;
+    }
+    for (long i = 0; i < ops; i++) {
+        writer.write(generator.next());
+    }
+    if (!writer.close()) {
+        cerr << "cannot write " << path << endl;
+        return 1;
+    }
+    cout << writer.count() << " operations written to " << path << endl;
+    return 0;
+}
+
+int info(const string &path) {
+    TraceReader reader;
+    if (!reader.open(path)) {
+        cerr << "cannot read " << path << endl;
+        return 1;
+    }
+    long counts[4] = {0, 0, 0, 0};
+    double micros = 0;
+    TraceRecord record;
+    while (reader.next(record)) {
+        counts[record.op]++;
+        micros += double(record.delayMicros);
+    }
+    long total = counts[0] + counts[1] + counts[2] + counts[3];
+    for (int op = TRACE_INSERT; op <= TRACE_UPDATE; op++) {
+        cout << setw(8) << OPNAMES[op] << setw(12) << counts[op] << endl;
+    }
+    cout << setw(8) << "total" << setw(12) << total << "   over " << micros / 1e6 << " s recorded" << endl;
+    return 0;
+}
+
+int replay(const string &path, int argc, char **argv) {
+    double speedup = 0, rate = 0;
+    prob_t policy = DEFPOLCY;
+    int size = MINPRIME;
+    bool fixedSeeds = false;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--speedup") {
+            speedup = atof(value.c_str());
+        } else if (option == "--rate") {
+            rate = atof(value.c_str());
+        } else if (option == "--size") {
+            size = atoi(value.c_str());
+        } else if (option == "--policy") {
+            policy = value == "linear" ? LINEAR : value == "doublehash" ? DOUBLEHASH : QUADRATIC;
+        } else if (option == "--seeds") {
+            fixedSeeds = value == "fixed";
+        } else {
+            cerr << "unknown option " << option << endl;
+            return 1;
+        }
+    }
+
+    TraceReader reader;
+    if (!reader.open(path)) {
+        cerr << "cannot read " << path << endl;
+        return 1;
+    }
+    VacDB vacdb(size, hashCode, policy);
+    //fixed seeds make the chain guard rebuild the same tables on every replay
+    vacdb.setDeterministicSeeds(fixedSeeds);
+    ReplayStats stats = replayTrace(reader, vacdb, speedup, rate);
+    for (int op = TRACE_INSERT; op <= TRACE_UPDATE; op++) {
+        cout << setw(8) << OPNAMES[op] << setw(12) << stats.ops[op] << setw(12) << stats.succeeded[op]
+             << " succeeded" << endl;
+    }
+    cout << stats.total() << " operations in " << stats.seconds << " s = "
+         << (stats.seconds > 0 ? stats.total() / stats.seconds : 0) << " ops/s" << endl;
+    cout << "latency us: p50 " << stats.p50Micros << "  p99 " << stats.p99Micros
+         << "  max " << stats.maxMicros << endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        cerr << "usage: Workload generate|replay|info <trace> [options]" << endl;
+        return 1;
+    }
+    string command = argv[1];
+    string path = argv[2];
+    if (command == "generate") {
+        return generate(path, argc, argv);
+    } else if (command == "replay") {
+        return replay(path, argc, argv);
+    } else if (command == "info") {
+        return info(path);
+    }
+    cerr << "unknown command " << command << endl;
+    return 1;
+}
+
+unsigned int hashCode(const string str) {
+    unsigned int val = 0;
+    const unsigned int thirtyThree = 33;  // magic number from textbook
+    for (unsigned int i = 0; i < str.length(); i++)
+        val = val * thirtyThree + str[i];
+    return val;
+}